@@ -1,453 +1,233 @@
 #include <iostream>
 #include <cstring>
 #include <cstdlib>
-#include <sys/socket.h>
-#include <arpa/inet.h>
-#include <unistd.h>
+#include <memory>
 #include <vector>
 #include <algorithm>
 #include <limits>
 #include <random>
 #include <chrono>
+#include <thread>
+#include <atomic>
+#include <type_traits>
+#include "engine.hpp"
+#include "eval_weights.hpp"
+#include "mcts.hpp"
+#include "opening_book.hpp"
+#include "transport.hpp"
 
 using namespace std;
 
-const int BOARD_SIZE = 5;
-const int WIN_LENGTH = 4;
-const int LOSE_LENGTH = 3;
-const int MAX_DEPTH = 10;
-const int INF = 1000000;
-
-struct Board {
-    char grid[BOARD_SIZE][BOARD_SIZE];
-
-    Board() {
-        for (int i = 0; i < BOARD_SIZE; i++) {
-            for (int j = 0; j < BOARD_SIZE; j++) {
-                grid[i][j] = '.';
-            }
-        }
-    }
-
-    bool isEmptyCell(int row, int col) const {
-        return grid[row][col] == '.';
-    }
-
-    void makeMove(int row, int col, char symbol) {
-        grid[row][col] = symbol;
-    }
-
-    void undoMove(int row, int col) {
-        grid[row][col] = '.';
-    }
-
-    void print() const {
-        cout << "  1 2 3 4 5\n";
-        for (int i = 0; i < BOARD_SIZE; i++) {
-            cout << i+1 << " ";
-            for (int j = 0; j < BOARD_SIZE; j++) {
-                cout << grid[i][j] << " ";
-            }
-            cout << endl;
-        }
-    }
-};
-
-struct Move {
-    int row;
-    int col;
-    int score;
-
-    Move(int r = -1, int c = -1, int s = 0) : row(r), col(c), score(s) {}
-};
-
+// Plays one game of the variant whose Rules it is compiled for. The opening
+// book and MCTS only know the 5x5 board.
+template <class R>
 class MinimaxClient {
 private:
-    int sockfd;
-    char mySymbol;
-    char opponentSymbol;
+    typedef BasicPosition<R> Position;
+    static constexpr int BOARD_SIZE = R::BOARD_SIZE;
+    static constexpr int NUM_CELLS = R::NUM_CELLS;
+    static constexpr bool DEFAULT_BOARD = is_same<R, DefaultRules>::value;
+
+    unique_ptr<ServerConnection> server;
+    bool useSharedMemory;
     int playerNumber;
     string playerName;
     int maxDepth;
-    Board board;
-    mt19937 rng;
+    Position position;
+    BasicEngine<R> engine;
     bool useAI;
-
-    const int directions[4][2] = {{0, 1}, {1, 0}, {1, 1}, {1, -1}};
+    bool useMcts;
+    MctsEngine mcts;
+    uint64_t playouts;
+    int moveTimeMs;
+    OpeningBook book;
+    mt19937 bookRng;
+
+    // Pondering: while the opponent thinks, a background thread owns the
+    // engine and searches our answer to each reply, predicted one first.
+    bool usePonder;
+    thread ponderThread;
+    atomic<bool> stopPonder;
+    SearchResult ponderAnswers[NUM_CELLS];
+    bool ponderReady[NUM_CELLS];
 
 public:
-    MinimaxClient(const string& serverIP, int port, int player, const string& name, int depth, bool ai)
-        : playerNumber(player), playerName(name), maxDepth(depth), useAI(ai),
-          rng(chrono::steady_clock::now().time_since_epoch().count()) {
-        mySymbol = (player == 1) ? 'X' : 'O';
-        opponentSymbol = (player == 1) ? 'O' : 'X';
-
-        sockfd = socket(AF_INET, SOCK_STREAM, 0);
-        if (sockfd < 0) {
-            cerr << "Socket creation error" << endl;
-            exit(1);
+    MinimaxClient(const string& serverIP, int port, int player, const string& name, int depth, int ai,
+                  const string& bookPath, bool ponder, const MctsOptions& mctsOptions,
+                  uint64_t mctsPlayouts, int mctsMoveTimeMs, bool sharedMemory, const EvalWeights& weights)
+        : useSharedMemory(sharedMemory), playerNumber(player), playerName(name), maxDepth(depth),
+          engine(chrono::steady_clock::now().time_since_epoch().count()),
+          useAI(ai > 0), useMcts(ai == 2), mcts(mctsOptions), playouts(mctsPlayouts),
+          moveTimeMs(mctsMoveTimeMs), bookRng(random_device()()), usePonder(ponder && ai == 1),
+          stopPonder(false) {
+        for (int cell = 0; cell < NUM_CELLS; cell++) {
+            ponderReady[cell] = false;
         }
+        engine.setWeights(weights);
 
-        struct sockaddr_in serverAddr;
-        serverAddr.sin_family = AF_INET;
-        serverAddr.sin_port = htons(port);
-        inet_pton(AF_INET, serverIP.c_str(), &serverAddr.sin_addr);
+        if (!bookPath.empty()) {
+            if (book.load(bookPath)) {
+                cout << "Loaded opening book with " << book.size() << " positions" << endl;
+            } else {
+                cerr << "Could not load opening book " << bookPath << endl;
+            }
+        }
 
-        if (connect(sockfd, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) < 0) {
-            cerr << "Connection error" << endl;
+        try {
+            server.reset(new ServerConnection(serverIP, port));
+        } catch (const exception& e) {
+            cerr << "Connection error: " << e.what() << endl;
             exit(1);
         }
     }
 
     ~MinimaxClient() {
-        close(sockfd);
+        stopPondering();
     }
 
     string receiveMessage() {
-        char buffer[256];
-        memset(buffer, 0, sizeof(buffer));
-        int n = recv(sockfd, buffer, sizeof(buffer) - 1, 0);
-        if (n <= 0) {
+        string_view msg;
+        if (!server->receive(msg)) {
             cerr << "Error receiving message" << endl;
             exit(1);
         }
-        string msg(buffer);
-        while (!msg.empty() && (msg.back() == '\n' || msg.back() == '\r')) {
-            msg.pop_back();
-        }
-        return msg;
+        return string(msg);
     }
 
     void sendMessage(const string& msg) {
-        send(sockfd, msg.c_str(), msg.length(), 0);
+        server->send(msg);
     }
 
     string positionToString(int row, int col) {
         return to_string(row + 1) + to_string(col + 1);
     }
 
-    void stringToPosition(const string& pos, int& row, int& col) {
-        row = pos[0] - '1';
-        col = pos[1] - '1';
-    }
-
-    int evaluatePosition(char symbol) {
-        int score = 0;
-
+    void printBoard() const {
+        cout << " ";
+        for (int j = 0; j < BOARD_SIZE; j++) {
+            cout << " " << j+1;
+        }
+        cout << "\n";
         for (int i = 0; i < BOARD_SIZE; i++) {
+            cout << i+1 << " ";
             for (int j = 0; j < BOARD_SIZE; j++) {
-                for (int d = 0; d < 4; d++) {
-                    int lineScore = evaluateLine(i, j, directions[d][0], directions[d][1], symbol);
-
-                    if (lineScore == INF || lineScore == -INF) {
-                        return lineScore;
-                    }
-
-                    score += lineScore;
-                }
-            }
-        }
-
-        int centerBonus = 0;
-        int center = BOARD_SIZE / 2;
-        for (int i = center - 1; i <= center + 1; i++) {
-            for (int j = center - 1; j <= center + 1; j++) {
-                if (i >= 0 && i < BOARD_SIZE && j >= 0 && j < BOARD_SIZE) {
-                    if (board.grid[i][j] == symbol) {
-                        centerBonus += 10;
-                    }
-                }
+                int value = position.cellValue(i * BOARD_SIZE + j);
+                cout << (value == 1 ? 'X' : value == 2 ? 'O' : '.') << " ";
             }
+            cout << endl;
         }
-
-        score += centerBonus;
-        return score;
     }
 
-    int evaluateLine(int row, int col, int dr, int dc, char symbol) {
-        int myCount = 0;
-        int opponentCount = 0;
-        int emptyCount = 0;
-
-        for (int i = 0; i < WIN_LENGTH; i++) {
-            int r = row + i * dr;
-            int c = col + i * dc;
+    void stringToPosition(const string& pos, int& row, int& col) {
+        row = pos[0] - '1';
+        col = pos[1] - '1';
+    }
 
-            if (r < 0 || r >= BOARD_SIZE || c < 0 || c >= BOARD_SIZE) {
-                return 0;
+    void makeHumanMove() {
+        int row, col;
+        while (true) {
+            cout << "Your turn. Enter row and column (1-" << BOARD_SIZE << "): ";
+            if (!(cin >> row >> col)) {
+                cin.clear(); cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                cout << "Invalid input. Try again." << endl;
+                continue;
             }
-
-            if (board.grid[r][c] == symbol) {
-                myCount++;
-            } else if (board.grid[r][c] == ((symbol == 'X') ? 'O' : 'X')) {
-                opponentCount++;
-            } else {
-                emptyCount++;
+            if (row < 1 || row > BOARD_SIZE || col < 1 || col > BOARD_SIZE) {
+                cout << "Out of range. Try again." << endl;
+                continue;
             }
-        }
-
-        if (opponentCount > 0) {
-            return 0;
-        }
-
-        if (myCount == WIN_LENGTH) {
-            return INF;
-        }
-
-        if (myCount == LOSE_LENGTH && emptyCount == 1) {
-            bool partOfFour = checkIfPartOfFour(row, col, dr, dc, symbol);
-            if (!partOfFour) {
-                return -INF;
+            if (!position.isEmpty((row-1) * BOARD_SIZE + (col-1))) {
+                cout << "Cell occupied. Try again." << endl;
+                continue;
             }
+            break;
         }
-
-        if (myCount == 3 && emptyCount == 1) {
-            return 50;
-        } else if (myCount == 2 && emptyCount == 2) {
-            return 20;
-        } else if (myCount == 1 && emptyCount == 3) {
-            return 5;
-        }
-
-        return 0;
+        position.play((row-1) * BOARD_SIZE + (col-1));
+        string mv = positionToString(row-1, col-1);
+        sendMessage(mv);
+        cout << "You moved: " << row << "," << col << endl;
+        printBoard();
     }
 
-    bool checkIfPartOfFour(int row, int col, int dr, int dc, char symbol) {
-        int prevRow = row - dr;
-        int prevCol = col - dc;
-        if (prevRow >= 0 && prevRow < BOARD_SIZE && prevCol >= 0 && prevCol < BOARD_SIZE) {
-            if (board.grid[prevRow][prevCol] == symbol) {
-                return true;
-            }
+    void startPondering() {
+        if (!usePonder) {
+            return;
         }
-
-        int nextRow = row + WIN_LENGTH * dr;
-        int nextCol = col + WIN_LENGTH * dc;
-        if (nextRow >= 0 && nextRow < BOARD_SIZE && nextCol >= 0 && nextCol < BOARD_SIZE) {
-            if (board.grid[nextRow][nextCol] == symbol) {
-                return true;
-            }
+        for (int cell = 0; cell < NUM_CELLS; cell++) {
+            ponderReady[cell] = false;
         }
-
-        return false;
+        ponderThread = thread(&MinimaxClient::ponder, this);
     }
 
-    int checkGameState(int lastRow, int lastCol, char symbol) {
-        for (int d = 0; d < 4; d++) {
-            int dr = directions[d][0];
-            int dc = directions[d][1];
-
-            for (int offset = 0; offset < WIN_LENGTH; offset++) {
-                int startRow = lastRow - offset * dr;
-                int startCol = lastCol - offset * dc;
-
-                if (startRow >= 0 && startRow < BOARD_SIZE && startCol >= 0 && startCol < BOARD_SIZE) {
-                    int count = 0;
-                    bool valid = true;
-
-                    for (int i = 0; i < WIN_LENGTH; i++) {
-                        int r = startRow + i * dr;
-                        int c = startCol + i * dc;
-
-                        if (r < 0 || r >= BOARD_SIZE || c < 0 || c >= BOARD_SIZE) {
-                            valid = false;
-                            break;
-                        }
-
-                        if (board.grid[r][c] == symbol) {
-                            count++;
-                        }
-                    }
-
-                    if (valid && count == WIN_LENGTH) {
-                        return 1;
-                    }
-                }
-            }
+    void stopPondering() {
+        if (ponderThread.joinable()) {
+            stopPonder = true;
+            ponderThread.join();
+            stopPonder = false;
         }
-
-        bool hasLosingThree = false;
-        bool hasWinningFour = false;
-
-        for (int d = 0; d < 4; d++) {
-            int dr = directions[d][0];
-            int dc = directions[d][1];
-
-            for (int offset = 0; offset < LOSE_LENGTH; offset++) {
-                int startRow = lastRow - offset * dr;
-                int startCol = lastCol - offset * dc;
-
-                if (startRow >= 0 && startRow < BOARD_SIZE && startCol >= 0 && startCol < BOARD_SIZE) {
-                    int count = 0;
-                    bool valid = true;
-
-                    for (int i = 0; i < LOSE_LENGTH; i++) {
-                        int r = startRow + i * dr;
-                        int c = startCol + i * dc;
-
-                        if (r < 0 || r >= BOARD_SIZE || c < 0 || c >= BOARD_SIZE) {
-                            valid = false;
-                            break;
-                        }
-
-                        if (board.grid[r][c] == symbol) {
-                            count++;
-                        }
-                    }
-
-                    if (valid && count == LOSE_LENGTH) {
-                        if (!checkIfPartOfFour(startRow, startCol, dr, dc, symbol)) {
-                            hasLosingThree = true;
-                        }
-                    }
-                }
-            }
-        }
-
-        if (hasLosingThree && !hasWinningFour) {
-            return -1;
-        }
-
-        return 0;
     }
 
-    Move minimax(int depth, bool isMaximizing, int alpha, int beta) {
-        if (depth == 0) {
-            Move move;
-            move.score = evaluatePosition(mySymbol) - evaluatePosition(opponentSymbol);
-            return move;
+    void ponder() {
+        vector<int> replies;
+        int predicted = engine.hashMove(position);
+        if (predicted >= 0) {
+            replies.push_back(predicted);
         }
-
-        vector<Move> possibleMoves;
-        for (int i = 0; i < BOARD_SIZE; i++) {
-            for (int j = 0; j < BOARD_SIZE; j++) {
-                if (board.isEmptyCell(i, j)) {
-                    possibleMoves.push_back(Move(i, j, 0));
-                }
+        for (int cell = 0; cell < NUM_CELLS; cell++) {
+            if (cell != predicted && position.isEmpty(cell)) {
+                replies.push_back(cell);
             }
         }
 
-        if (possibleMoves.empty()) {
-            Move move;
-            move.score = evaluatePosition(mySymbol) - evaluatePosition(opponentSymbol);
-            return move;
-        }
-
-        Move bestMove;
-        vector<Move> equalMoves;
-
-        if (isMaximizing) {
-            bestMove.score = -INF - 1;
-
-            for (const auto& move : possibleMoves) {
-                board.makeMove(move.row, move.col, mySymbol);
-
-                int gameState = checkGameState(move.row, move.col, mySymbol);
-
-                Move currentMove = move;
-                if (gameState == 1) {
-                    currentMove.score = INF;
-                } else if (gameState == -1) {
-                    currentMove.score = -INF;
-                } else {
-                    Move nextMove = minimax(depth - 1, false, alpha, beta);
-                    currentMove.score = nextMove.score;
-                }
-
-                board.undoMove(move.row, move.col);
-
-                if (currentMove.score > bestMove.score) {
-                    bestMove = currentMove;
-                    equalMoves.clear();
-                    equalMoves.push_back(currentMove);
-                } else if (currentMove.score == bestMove.score) {
-                    equalMoves.push_back(currentMove);
-                }
-
-                alpha = max(alpha, currentMove.score);
-                if (beta <= alpha) {
-                    break;
-                }
-            }
-        } else {
-            bestMove.score = INF + 1;
-
-            for (const auto& move : possibleMoves) {
-                board.makeMove(move.row, move.col, opponentSymbol);
-
-                int gameState = checkGameState(move.row, move.col, opponentSymbol);
-
-                Move currentMove = move;
-                if (gameState == 1) {
-                    currentMove.score = -INF;
-                } else if (gameState == -1) {
-                    currentMove.score = INF;
-                } else {
-                    Move nextMove = minimax(depth - 1, true, alpha, beta);
-                    currentMove.score = nextMove.score;
-                }
-
-                board.undoMove(move.row, move.col);
-
-                if (currentMove.score < bestMove.score) {
-                    bestMove = currentMove;
-                    equalMoves.clear();
-                    equalMoves.push_back(currentMove);
-                } else if (currentMove.score == bestMove.score) {
-                    equalMoves.push_back(currentMove);
-                }
-
-                beta = min(beta, currentMove.score);
-                if (beta <= alpha) {
+        SearchLimits limits;
+        limits.depth = maxDepth;
+        limits.stop = &stopPonder;
+        for (int cell : replies) {
+            Position reply = position;
+            reply.play(cell);
+            if (reply.outcome(cell) == 0 && !reply.isFull()) {
+                SearchResult answer = engine.search(reply, limits);
+                if (answer.aborted) {
                     break;
                 }
+                ponderAnswers[cell] = answer;
+                ponderReady[cell] = true;
             }
         }
-
-        if (!equalMoves.empty()) {
-            uniform_int_distribution<int> dist(0, equalMoves.size() - 1);
-            bestMove = equalMoves[dist(rng)];
-        }
-
-        return bestMove;
     }
 
-    void makeHumanMove() {
-        int row, col;
-        while (true) {
-            cout << "Your turn. Enter row and column (1-5): ";
-            if (!(cin >> row >> col)) {
-                cin.clear(); cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                cout << "Invalid input. Try again." << endl;
-                continue;
-            }
-            if (row < 1 || row > BOARD_SIZE || col < 1 || col > BOARD_SIZE) {
-                cout << "Out of range. Try again." << endl;
-                continue;
-            }
-            if (!board.isEmptyCell(row-1, col-1)) {
-                cout << "Cell occupied. Try again." << endl;
-                continue;
+    void makeAIMove(int opponentCell = -1) {
+        SearchResult best;
+        if constexpr (DEFAULT_BOARD) {
+            best.move = book.pickMove(position, bookRng, &best.score);
+        }
+        if (best.move >= 0) {
+            cout << "AI played from book" << endl;
+        } else if (opponentCell >= 0 && ponderReady[opponentCell]) {
+            best = ponderAnswers[opponentCell];
+            cout << "AI answered from ponder search" << endl;
+        } else if (useMcts) {
+            cout << "AI is running playouts..." << endl;
+            SearchLimits limits;
+            limits.nodes = playouts;
+            limits.moveTimeMs = moveTimeMs;
+            if constexpr (DEFAULT_BOARD) {
+                best = mcts.search(position, limits);
             }
-            break;
+        } else {
+            cout << "AI is thinking..." << endl;
+            SearchLimits limits;
+            limits.depth = maxDepth;
+            best = engine.search(position, limits);
         }
-        board.makeMove(row-1, col-1, mySymbol);
-        string mv = positionToString(row-1, col-1);
-        sendMessage(mv);
-        cout << "You moved: " << row << "," << col << endl;
-        board.print();
-    }
-
-    void makeAIMove() {
-        cout << "AI is thinking..." << endl;
-        Move bestMove = minimax(maxDepth, true, -INF - 1, INF + 1);
-        int row = bestMove.row;
-        int col = bestMove.col;
-        board.makeMove(row, col, mySymbol);
+        int row = best.move / BOARD_SIZE;
+        int col = best.move % BOARD_SIZE;
+        position.play(best.move);
         string mv = positionToString(row, col);
         sendMessage(mv);
-        cout << "AI moved: " << row+1 << "," << col+1 << " (score: " << bestMove.score << ")" << endl;
-        board.print();
+        cout << "AI moved: " << row+1 << "," << col+1 << " (score: " << best.score << ")" << endl;
+        printBoard();
+        startPondering();
     }
 
     void play() {
@@ -457,33 +237,37 @@ public:
             cerr << "Unexpected message: " << msg << endl;
             return;
         }
+        if (useSharedMemory) {
+            try {
+                server->useSharedMemory();
+            } catch (const exception& e) {
+                cerr << e.what() << endl;
+                return;
+            }
+        }
 
         string response = to_string(playerNumber) + " " + playerName;
         sendMessage(response);
         cout << "Sent: " << response << endl;
 
-        if (playerNumber == 1) {
-            msg = receiveMessage();
-            cout << "Server: " << msg << endl;
-            if (msg.substr(0, 3) != "600") {
-                cerr << "Unexpected message: " << msg << endl;
-                return;
-            }
-            board.print();
-            if (useAI) {
-                makeAIMove();
-            } else {
-                makeHumanMove();
-            }
-        }
-
+        bool sideKnown = false;
         while (true) {
             msg = receiveMessage();
+            stopPondering();
             cout << "Server: " << msg << endl;
             int code = stoi(msg);
             int type = code / 100;
             int mv = code % 100;
 
+            // The lobby may seat us on either side, whatever we asked for:
+            // 600 means X, an opponent move first means O
+            if (!sideKnown && (type == 0 || type == 6)) {
+                sideKnown = true;
+                playerNumber = type == 6 ? 1 : 2;
+                cout << "Playing as " << (playerNumber == 1 ? "X" : "O") << endl;
+                if (type == 6) printBoard();
+            }
+
             if (type >= 1 && type <= 5) {
                 if (type == 1) cout << "You win!" << endl;
                 else if (type == 2) cout << "You lose!" << endl;
@@ -493,16 +277,18 @@ public:
                 break;
             }
 
-            if (mv >= 11 && mv <= 55) {
-                int row = (mv / 10) - 1;
-                int col = (mv % 10) - 1;
-                board.makeMove(row, col, opponentSymbol);
+            int opponentCell = -1;
+            int row = (mv / 10) - 1;
+            int col = (mv % 10) - 1;
+            if (row >= 0 && row < BOARD_SIZE && col >= 0 && col < BOARD_SIZE) {
+                opponentCell = row * BOARD_SIZE + col;
+                position.play(opponentCell);
                 cout << "Opponent moved: " << row+1 << "," << col+1 << endl;
-                board.print();
+                printBoard();
             }
 
             if (useAI) {
-                makeAIMove();
+                makeAIMove(opponentCell);
             } else {
                 makeHumanMove();
             }
@@ -511,22 +297,82 @@ public:
 };
 
 int main(int argc, char* argv[]) {
-    if (argc < 5 || argc > 7) {
-        cerr << "Usage: " << argv[0] << " <server_ip> <port> <player_number> <name> [depth] [ai]" << endl;
+    if (argc >= 3 && string(argv[1]) == "--build-book") {
+        int plies = (argc > 3) ? atoi(argv[3]) : 3;
+        int depth = (argc > 4) ? atoi(argv[4]) : 6;
+        if (plies < 1 || depth < 1 || depth > MAX_DEPTH) {
+            cerr << "Book plies must be positive and depth between 1-10" << endl;
+            return 1;
+        }
+        Engine engine(0);
+        OpeningBook book = OpeningBook::build(engine, plies, depth, [](int ply, size_t positions) {
+            cout << "Ply " << ply << ": " << positions << " positions" << endl;
+        });
+        if (!book.save(argv[2])) {
+            cerr << "Could not write opening book " << argv[2] << endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    vector<string> args;
+    string bookPath;
+    bool ponder = false;
+    MctsOptions mctsOptions;
+    int playouts = 20000;
+    int moveTimeMs = 0;
+    bool sharedMemory = false;
+    int variant = DEFAULT_VARIANT;
+    string weightsPath;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--book" && i + 1 < argc) {
+            bookPath = argv[++i];
+        } else if (arg == "--ponder") {
+            ponder = true;
+        } else if (arg == "--playouts" && i + 1 < argc) {
+            playouts = atoi(argv[++i]);
+        } else if (arg == "--movetime" && i + 1 < argc) {
+            moveTimeMs = atoi(argv[++i]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            mctsOptions.threads = atoi(argv[++i]);
+        } else if (arg == "--rave") {
+            mctsOptions.rave = true;
+        } else if (arg == "--shm") {
+            sharedMemory = true;
+        } else if (arg == "--variant" && i + 1 < argc) {
+            variant = findVariant(argv[++i]);
+        } else if (arg == "--weights" && i + 1 < argc) {
+            weightsPath = argv[++i];
+        } else {
+            args.push_back(arg);
+        }
+    }
+
+    if (args.size() < 4 || args.size() > 6) {
+        cerr << "Usage: " << argv[0] << " <server_ip|unix:path> <port> <player_number (0=any)> <name> [depth] [ai] [options]" << endl;
+        cerr << "       " << argv[0] << " --build-book <file> [plies] [depth]" << endl;
         cerr << "  depth: AI depth (1-10), default=5" << endl;
-        cerr << "  ai: 0=human, 1=AI (default=0)" << endl;
+        cerr << "  ai: 0=human, 1=minimax AI, 2=MCTS AI (default=0)" << endl;
+        cerr << "  --book file: opening book played instantly while in book" << endl;
+        cerr << "  --ponder: search on the opponent's time (minimax AI)" << endl;
+        cerr << "  --playouts n, --movetime ms, --threads n, --rave: MCTS AI settings" << endl;
+        cerr << "  --shm: exchange messages through shared memory (unix: address only)" << endl;
+        cerr << "  --variant name: board to play, as on the server: " << VARIANT_NAMES << " (default "
+             << VARIANTS[DEFAULT_VARIANT].name << ")" << endl;
+        cerr << "  --weights file: evaluation weights for the minimax AI, as written by eval_tuner" << endl;
         return 1;
     }
 
-    string serverIP = argv[1];
-    int port = atoi(argv[2]);
-    int playerNumber = atoi(argv[3]);
-    string playerName = argv[4];
-    int depth = (argc > 5) ? atoi(argv[5]) : 5;
-    bool useAI = (argc > 6) ? (atoi(argv[6]) > 0) : false;
+    string serverIP = args[0];
+    int port = atoi(args[1].c_str());
+    int playerNumber = atoi(args[2].c_str());
+    string playerName = args[3];
+    int depth = (args.size() > 4) ? atoi(args[4].c_str()) : 5;
+    int ai = (args.size() > 5) ? atoi(args[5].c_str()) : 0;
 
-    if (playerNumber != 1 && playerNumber != 2) {
-        cerr << "Player number must be 1 or 2" << endl;
+    if (playerNumber < 0 || playerNumber > 2) {
+        cerr << "Player number must be 0 (any side), 1 or 2" << endl;
         return 1;
     }
 
@@ -540,9 +386,43 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    cout << (useAI ? "AI" : "Human") << " player mode with depth=" << depth << endl;
+    if (ai < 0 || ai > 2) {
+        cerr << "AI mode must be 0, 1 or 2" << endl;
+        return 1;
+    }
+
+    if (variant < 0) {
+        cerr << "Variant must be one of " << VARIANT_NAMES << endl;
+        return 1;
+    }
+
+    if (variant != DEFAULT_VARIANT && (ai == 2 || !bookPath.empty())) {
+        cerr << "MCTS and opening books play " << VARIANTS[DEFAULT_VARIANT].name << " only" << endl;
+        return 1;
+    }
+
+    EvalWeights weights;
+    if (!weightsPath.empty() && !loadWeights(weightsPath, weights)) {
+        cerr << "Could not read weights " << weightsPath << endl;
+        return 1;
+    }
+
+    if (playouts < 1 || moveTimeMs < 0 || mctsOptions.threads < 1) {
+        cerr << "Playouts and threads must be positive" << endl;
+        return 1;
+    }
+
+    if (ai == 2) {
+        cout << "MCTS AI player mode with " << playouts << " playouts on "
+             << mctsOptions.threads << " thread(s)" << (mctsOptions.rave ? " with RAVE" : "") << endl;
+    } else {
+        cout << (ai == 1 ? "AI" : "Human") << " player mode with depth=" << depth << endl;
+    }
 
-    MinimaxClient client(serverIP, port, playerNumber, playerName, depth, useAI);
-    client.play();
+    withVariant(variant, [&](auto rules) {
+        MinimaxClient<decltype(rules)> client(serverIP, port, playerNumber, playerName, depth, ai, bookPath, ponder,
+                                              mctsOptions, playouts, moveTimeMs, sharedMemory, weights);
+        client.play();
+    });
     return 0;
 }
\ No newline at end of file
@@ -1,91 +1,187 @@
 #pragma once
-#include <vector>
-#include <iostream>
 #include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include "variants.hpp"
+
+// Lines of `length` cells on a `size` x `size` board: rows and columns, then
+// both diagonal directions.
+constexpr int boardLineCount(int size, int length) {
+    return 2 * size * (size - length + 1) + 2 * (size - length + 1) * (size - length + 1);
+}
+
+// Largest value of `field`, or of the line count, over all variants.
+constexpr int largestOfVariants(int Variant::*field) {
+    int most = 0;
+    for (const Variant& variant : VARIANTS) most = variant.*field > most ? variant.*field : most;
+    return most;
+}
+
+constexpr int mostVariantLines() {
+    int most = 0;
+    for (const Variant& variant : VARIANTS) {
+        int lines = boardLineCount(variant.size, variant.loseLength);
+        most = lines > most ? lines : most;
+    }
+    return most;
+}
+
+// Every winning and every forbidden line of a variant as a bitmask over cells
+// row * size + col, generated at compile time, with the lines through each
+// cell listed separately so a move is judged by the few lines it can have
+// completed. Arrays are sized for the largest variant.
+struct BoardPatterns {
+    static constexpr int MAX_SIZE = largestOfVariants(&Variant::size);
+    static constexpr int MAX_CELLS = MAX_SIZE * MAX_SIZE;
+    static constexpr int MAX_LENGTH = largestOfVariants(&Variant::winLength);
+    static constexpr int MAX_LINES = mostVariantLines();  // forbidden lines are shorter, so there are more of them
+
+    static_assert(MAX_CELLS <= 64, "GameBoard keeps each side's stones in 64 bits");
+
+    int size;
+    int cells;
+    int winCount;
+    int loseCount;
+    std::array<uint64_t, MAX_LINES> win{};
+    std::array<uint64_t, MAX_LINES> lose{};
+    std::array<std::array<uint64_t, 4 * MAX_LENGTH>, MAX_CELLS> winThrough{};
+    std::array<int, MAX_CELLS> winThroughCount{};
+    std::array<std::array<uint64_t, 4 * MAX_LENGTH>, MAX_CELLS> loseThrough{};
+    std::array<int, MAX_CELLS> loseThroughCount{};
+
+    constexpr explicit BoardPatterns(const Variant& variant)
+        : size(variant.size), cells(variant.size * variant.size),
+          winCount(boardLineCount(variant.size, variant.winLength)),
+          loseCount(boardLineCount(variant.size, variant.loseLength)) {
+        generate(variant.winLength, win, winThrough, winThroughCount);
+        generate(variant.loseLength, lose, loseThrough, loseThroughCount);
+    }
+
+    // Fills `all` with every line of `length` cells and `through[cell]` with
+    // the ones that cover each cell.
+    constexpr void generate(int length, std::array<uint64_t, MAX_LINES>& all,
+                            std::array<std::array<uint64_t, 4 * MAX_LENGTH>, MAX_CELLS>& through,
+                            std::array<int, MAX_CELLS>& throughCount) {
+        const int directions[4][2] = {{0, 1}, {1, 0}, {1, 1}, {1, -1}};
+        int count = 0;
+        for (int d = 0; d < 4; d++) {
+            for (int row = 0; row < size; row++) {
+                for (int col = 0; col < size; col++) {
+                    int lastRow = row + (length - 1) * directions[d][0];
+                    int lastCol = col + (length - 1) * directions[d][1];
+                    if (lastRow >= size || lastCol < 0 || lastCol >= size) continue;
+
+                    uint64_t mask = 0;
+                    for (int i = 0; i < length; i++) {
+                        mask |= uint64_t(1) << ((row + i * directions[d][0]) * size + col + i * directions[d][1]);
+                    }
+                    for (int cell = 0; cell < cells; cell++) {
+                        if (mask & (uint64_t(1) << cell)) through[cell][throughCount[cell]++] = mask;
+                    }
+                    all[count++] = mask;
+                }
+            }
+        }
+    }
+};
+
+inline constexpr BoardPatterns boardPatterns[] = {
+    BoardPatterns(VARIANTS[0]),
+    BoardPatterns(VARIANTS[1]),
+    BoardPatterns(VARIANTS[2]),
+    BoardPatterns(VARIANTS[3]),
+};
+
+static_assert(sizeof(boardPatterns) / sizeof(boardPatterns[0]) == VARIANT_COUNT, "patterns for every variant");
+static_assert(boardPatterns[1].winCount == 28 && boardPatterns[1].loseCount == 48, "5x5 board has 28 fours and 48 threes");
+static_assert(boardPatterns[1].win[27] != 0 && boardPatterns[1].lose[47] != 0, "every pattern is generated");
 
 class GameBoard {
 private:
-    std::array<std::array<int, 5>, 5> grid;
-
-    static const std::array<std::array<std::array<int, 2>, 4>, 28> winPatterns;
-    static const std::array<std::array<std::array<int, 2>, 3>, 48> losePatterns;
+    const BoardPatterns* patterns;
+    uint64_t stones[2];  // X, O
+    int lastCell;        // where the last move went, -1 before the first
 
 public:
-    GameBoard() { reset(); }
+    explicit GameBoard(int variant = DEFAULT_VARIANT) : patterns(&boardPatterns[variant]) { reset(); }
 
     void reset() {
-        for (int row = 0; row < 5; row++) {
-            for (int col = 0; col < 5; col++) {
-                grid[row][col] = 0;
-            }
-        }
+        stones[0] = 0;
+        stones[1] = 0;
+        lastCell = -1;
     }
 
-    void display() {
-        std::cout << "  1 2 3 4 5\n";
-        for (int row = 0; row < 5; row++) {
-            std::cout << row + 1;
-            for (int col = 0; col < 5; col++) {
+    int size() const {
+        return patterns->size;
+    }
+
+    int cellCount() const {
+        return patterns->cells;
+    }
+
+    void display(std::ostream& out = std::cout) const {
+        out << " ";
+        for (int col = 0; col < size(); col++) {
+            out << " " << col + 1;
+        }
+        out << "\n";
+        for (int row = 0; row < size(); row++) {
+            out << row + 1;
+            for (int col = 0; col < size(); col++) {
                 char symbol = '-';
-                if (grid[row][col] == 1) symbol = 'X';
-                else if (grid[row][col] == 2) symbol = 'O';
-                std::cout << " " << symbol;
+                if (getCellValue(row, col) == 1) symbol = 'X';
+                else if (getCellValue(row, col) == 2) symbol = 'O';
+                out << " " << symbol;
             }
-            std::cout << "\n";
+            out << "\n";
         }
-        std::cout << "\n";
+        out << "\n";
     }
 
     bool placeMove(int move, int player) {
         int row = (move / 10) - 1;
         int col = (move % 10) - 1;
 
-        if (row < 0 || row > 4 || col < 0 || col > 4) return false;
-        if (grid[row][col] != 0) return false;
+        if (row < 0 || row > size() - 1 || col < 0 || col > size() - 1) return false;
+        if (getCellValue(row, col) != 0) return false;
 
-        grid[row][col] = player;
+        lastCell = row * size() + col;
+        stones[player - 1] |= uint64_t(1) << lastCell;
         return true;
     }
 
-    bool checkWin(int player) {
-        for (const auto& pattern : winPatterns) {
-            if (grid[pattern[0][0]][pattern[0][1]] == player &&
-                grid[pattern[1][0]][pattern[1][1]] == player &&
-                grid[pattern[2][0]][pattern[2][1]] == player &&
-                grid[pattern[3][0]][pattern[3][1]] == player) {
-                return true;
-            }
+    // Whether the last move made four in a row for `player`. Only the lines
+    // through that move are tested: any earlier four would already have
+    // ended the game.
+    bool checkWin(int player) const {
+        if (lastCell < 0) return false;
+        uint64_t own = stones[player - 1];
+        for (int i = 0; i < patterns->winThroughCount[lastCell]; i++) {
+            uint64_t pattern = patterns->winThrough[lastCell][i];
+            if ((own & pattern) == pattern) return true;
         }
         return false;
     }
 
-    bool checkLose(int player) {
-        for (const auto& pattern : losePatterns) {
-            if (grid[pattern[0][0]][pattern[0][1]] == player &&
-                grid[pattern[1][0]][pattern[1][1]] == player &&
-                grid[pattern[2][0]][pattern[2][1]] == player) {
-                return true;
-            }
+    // Whether the last move made a forbidden three for `player`.
+    bool checkLose(int player) const {
+        if (lastCell < 0) return false;
+        uint64_t own = stones[player - 1];
+        for (int i = 0; i < patterns->loseThroughCount[lastCell]; i++) {
+            uint64_t pattern = patterns->loseThrough[lastCell][i];
+            if ((own & pattern) == pattern) return true;
         }
         return false;
     }
 
     int getCellValue(int row, int col) const {
-        if (row >= 0 && row < 5 && col >= 0 && col < 5) {
-            return grid[row][col];
+        if (row >= 0 && row < size() && col >= 0 && col < size()) {
+            uint64_t bit = uint64_t(1) << (row * size() + col);
+            if (stones[0] & bit) return 1;
+            if (stones[1] & bit) return 2;
+            return 0;
         }
         return -1;
     }
 };
-
-const std::array<std::array<std::array<int, 2>, 4>, 28> GameBoard::winPatterns = {{
-    {{{{0, 0}}, {{0, 1}}, {{0, 2}}, {{0, 3}}}},
-    {{{{1, 0}}, {{1, 1}}, {{1, 2}}, {{1, 3}}}},
-    /* ... remaining win patterns ... */
-}};
-
-const std::array<std::array<std::array<int, 2>, 3>, 48> GameBoard::losePatterns = {{
-    {{{{0, 0}}, {{0, 1}}, {{0, 2}}}},
-    {{{{0, 1}}, {{0, 2}}, {{0, 3}}}},
-    /* ... remaining lose patterns ... */
-}};
\ No newline at end of file
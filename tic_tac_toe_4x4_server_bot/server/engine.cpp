@@ -0,0 +1,8 @@
+#include "engine.hpp"
+
+// The search for each variant, instantiated here once instead of in every
+// tool that links the engine.
+template class BasicEngine<Rules4x4>;
+template class BasicEngine<Rules5x5>;
+template class BasicEngine<Rules6x6>;
+template class BasicEngine<Rules7x7>;
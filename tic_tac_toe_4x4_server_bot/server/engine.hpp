@@ -0,0 +1,1097 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "variants.hpp"
+
+// Board, rules and alpha-beta search, with no I/O, so the same engine can
+// run in the clients, the server and offline tools. Everything is a template
+// on the variant's Rules, so each board size gets its own bitboard type and
+// tables with compile-time sizes; the 5x5 game has the short names
+// (Position, Engine, ...) that most tools use.
+//
+// Cells are numbered row * BOARD_SIZE + col. Positions are a pair of
+// bitboards; X always moves first, so the side to move follows from the
+// stone counts. Scores are from the side to move's point of view.
+
+constexpr int NUM_SYMMETRIES = 8;
+constexpr int MAX_DEPTH = 10;
+constexpr int INF = 1000000;
+
+__extension__ typedef unsigned __int128 uint128_t;
+
+inline int popCount(uint32_t b) { return __builtin_popcount(b); }
+inline int popCount(uint64_t b) { return __builtin_popcountll(b); }
+inline int popCount(uint128_t b) { return popCount(uint64_t(b)) + popCount(uint64_t(b >> 64)); }
+
+// Index of the lowest set bit; b must not be 0.
+inline int lowestCell(uint32_t b) { return __builtin_ctz(b); }
+inline int lowestCell(uint64_t b) { return __builtin_ctzll(b); }
+inline int lowestCell(uint128_t b) { return uint64_t(b) ? lowestCell(uint64_t(b)) : 64 + lowestCell(uint64_t(b >> 64)); }
+
+template <int Size, int Win, int Lose>
+struct Rules {
+    static constexpr int BOARD_SIZE = Size;
+    static constexpr int WIN_LENGTH = Win;
+    static constexpr int LOSE_LENGTH = Lose;
+    static constexpr int NUM_CELLS = Size * Size;
+
+    // The smallest word that holds the board with a bit to spare
+    typedef std::conditional_t<(NUM_CELLS < 32), uint32_t,
+                               std::conditional_t<(NUM_CELLS < 64), uint64_t, uint128_t>> Bitboard;
+
+    static constexpr Bitboard FULL_BOARD = (Bitboard(1) << NUM_CELLS) - 1;
+
+    static_assert(Size <= 9, "moves are sent as two digits");
+    static_assert(Lose < Win && Win <= Size, "a line of the losing length must fit inside a winning one");
+};
+
+template <int V>
+using VariantRules = Rules<VARIANTS[V].size, VARIANTS[V].winLength, VARIANTS[V].loseLength>;
+
+typedef VariantRules<0> Rules4x4;
+typedef VariantRules<1> Rules5x5;
+typedef VariantRules<2> Rules6x6;
+typedef VariantRules<3> Rules7x7;
+typedef VariantRules<DEFAULT_VARIANT> DefaultRules;
+
+// Calls `visit` with the Rules of variant `variant` (an index into VARIANTS),
+// so a tool picks its variant at run time and every search it runs is
+// compiled for that board.
+template <typename Visitor>
+auto withVariant(int variant, Visitor&& visit) {
+    static_assert(VARIANT_COUNT == 4, "every variant needs a case here");
+    switch (variant) {
+    case 0: return visit(Rules4x4());
+    case 2: return visit(Rules6x6());
+    case 3: return visit(Rules7x7());
+    default: return visit(Rules5x5());
+    }
+}
+
+template <class R>
+inline typename R::Bitboard cellBitOf(int cell) {
+    return typename R::Bitboard(1) << cell;
+}
+
+// The 8 dihedral symmetries of the board. Symmetry s transposes when bit 2 is
+// set, then mirrors rows (bit 0) and columns (bit 1). Bitboards are mapped one
+// row at a time through precomputed images, so a transform is one table
+// lookup per row.
+template <class R>
+struct SymmetryTables {
+    typedef typename R::Bitboard Bitboard;
+    static constexpr int N = R::BOARD_SIZE;
+
+    int cellImage[NUM_SYMMETRIES][R::NUM_CELLS];
+    int inverse[NUM_SYMMETRIES];
+    Bitboard rowImage[NUM_SYMMETRIES][N][1 << N];
+
+    SymmetryTables() {
+        for (int s = 0; s < NUM_SYMMETRIES; s++) {
+            for (int cell = 0; cell < R::NUM_CELLS; cell++) {
+                int r = cell / N;
+                int c = cell % N;
+                if (s & 4) std::swap(r, c);
+                if (s & 1) r = N - 1 - r;
+                if (s & 2) c = N - 1 - c;
+                cellImage[s][cell] = r * N + c;
+            }
+        }
+
+        for (int s = 0; s < NUM_SYMMETRIES; s++) {
+            for (int t = 0; t < NUM_SYMMETRIES; t++) {
+                bool identity = true;
+                for (int cell = 0; cell < R::NUM_CELLS; cell++) {
+                    if (cellImage[t][cellImage[s][cell]] != cell) {
+                        identity = false;
+                        break;
+                    }
+                }
+                if (identity) inverse[s] = t;
+            }
+        }
+
+        for (int s = 0; s < NUM_SYMMETRIES; s++) {
+            for (int row = 0; row < N; row++) {
+                for (int bits = 0; bits < (1 << N); bits++) {
+                    Bitboard image = 0;
+                    for (int col = 0; col < N; col++) {
+                        if (bits & (1 << col)) {
+                            image |= cellBitOf<R>(cellImage[s][row * N + col]);
+                        }
+                    }
+                    rowImage[s][row][bits] = image;
+                }
+            }
+        }
+    }
+
+    Bitboard transform(int s, Bitboard b) const {
+        Bitboard result = 0;
+        for (int row = 0; row < N; row++) {
+            result |= rowImage[s][row][int(b >> (row * N)) & ((1 << N) - 1)];
+        }
+        return result;
+    }
+};
+
+template <class R>
+inline const SymmetryTables<R> symmetryTables;
+
+struct CanonicalPosition {
+    uint64_t key;  // the smallest (X, O) bitboard pair over all symmetries
+    int sym;       // symmetry that maps the actual board onto the canonical one
+};
+
+// The canonical pair as a table key. Up to 32 cells both bitboards fit in the
+// key as they are; larger boards hash the pair down to 64 bits.
+template <class R>
+inline uint64_t positionKey(typename R::Bitboard x, typename R::Bitboard o) {
+    if constexpr (R::NUM_CELLS <= 32) {
+        return (uint64_t(x) << 32) | uint64_t(o);
+    } else {
+        auto mix = [](uint64_t z) {
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            return z ^ (z >> 31);
+        };
+        uint64_t high = uint64_t(uint128_t(x) >> 64) * 0x9E3779B97F4A7C15ULL ^ uint64_t(uint128_t(o) >> 64);
+        return mix(uint64_t(x) ^ mix(uint64_t(o) ^ mix(high)));
+    }
+}
+
+template <class R>
+inline CanonicalPosition canonicalizeOf(typename R::Bitboard x, typename R::Bitboard o) {
+    const SymmetryTables<R>& symmetries = symmetryTables<R>;
+    typename R::Bitboard bestX = x, bestO = o;
+    int best = 0;
+    for (int s = 1; s < NUM_SYMMETRIES; s++) {
+        typename R::Bitboard imageX = symmetries.transform(s, x);
+        typename R::Bitboard imageO = symmetries.transform(s, o);
+        if (imageX < bestX || (imageX == bestX && imageO < bestO)) {
+            bestX = imageX;
+            bestO = imageO;
+            best = s;
+        }
+    }
+    return {positionKey<R>(bestX, bestO), best};
+}
+
+// Masks of every winning and every forbidden line through each cell, and the
+// line windows used by the static evaluation. Every cell has the same number
+// of line slots, with lines that cannot fit padded by a mask no stones can
+// fill, so the rule check has a fixed trip count the compiler unrolls.
+template <class R>
+struct LineTables {
+    typedef typename R::Bitboard Bitboard;
+    static constexpr int N = R::BOARD_SIZE;
+    static constexpr int WIN_SLOTS = 4 * R::WIN_LENGTH;
+    static constexpr int LOSE_SLOTS = 4 * R::LOSE_LENGTH;
+    static constexpr Bitboard NEVER = Bitboard(1) << R::NUM_CELLS;  // off the board
+
+    struct Window {
+        Bitboard cells;
+        Bitboard ends;  // the cells just before and after the window, if on the board
+    };
+
+    Bitboard winLines[R::NUM_CELLS][WIN_SLOTS];
+    Bitboard loseLines[R::NUM_CELLS][LOSE_SLOTS];
+    Window windows[4 * R::NUM_CELLS];
+    int windowCount;
+    Bitboard centre;
+
+    LineTables() : windowCount(0), centre(0) {
+        const int directions[4][2] = {{0, 1}, {1, 0}, {1, 1}, {1, -1}};
+        int winCount[R::NUM_CELLS] = {};
+        int loseCount[R::NUM_CELLS] = {};
+        for (int cell = 0; cell < R::NUM_CELLS; cell++) {
+            for (int i = 0; i < WIN_SLOTS; i++) winLines[cell][i] = NEVER;
+            for (int i = 0; i < LOSE_SLOTS; i++) loseLines[cell][i] = NEVER;
+        }
+
+        for (int row = 0; row < N; row++) {
+            for (int col = 0; col < N; col++) {
+                for (int d = 0; d < 4; d++) {
+                    int dr = directions[d][0];
+                    int dc = directions[d][1];
+                    Bitboard win = line(row, col, dr, dc, R::WIN_LENGTH);
+                    Bitboard lose = line(row, col, dr, dc, R::LOSE_LENGTH);
+                    for (int cell = 0; cell < R::NUM_CELLS; cell++) {
+                        if (win & cellBitOf<R>(cell)) winLines[cell][winCount[cell]++] = win;
+                        if (lose & cellBitOf<R>(cell)) loseLines[cell][loseCount[cell]++] = lose;
+                    }
+                    if (win) {
+                        windows[windowCount++] = {win, line(row - dr, col - dc, dr, dc, 1) |
+                                                       line(row + R::WIN_LENGTH * dr, col + R::WIN_LENGTH * dc,
+                                                            dr, dc, 1)};
+                    }
+                }
+            }
+        }
+
+        // The middle 3x3 on odd boards, the middle 2x2 on even ones
+        int first = (N - 1) / 2 - (N % 2);
+        int last = N / 2 + (N % 2);
+        for (int row = first; row <= last; row++) {
+            for (int col = first; col <= last; col++) {
+                centre |= cellBitOf<R>(row * N + col);
+            }
+        }
+    }
+
+    // Mask of `length` cells from (row, col) along (dr, dc), or 0 if it leaves the board.
+    static Bitboard line(int row, int col, int dr, int dc, int length) {
+        Bitboard mask = 0;
+        for (int i = 0; i < length; i++) {
+            int r = row + i * dr;
+            int c = col + i * dc;
+            if (r < 0 || r >= N || c < 0 || c >= N) {
+                return 0;
+            }
+            mask |= cellBitOf<R>(r * N + c);
+        }
+        return mask;
+    }
+
+    // 1 if the stone just placed on `cell` makes four, -1 if it makes a
+    // forbidden three, 0 otherwise.
+    int outcome(Bitboard stones, int cell) const {
+        bool win = false;
+        for (int i = 0; i < WIN_SLOTS; i++) {
+            win |= (stones & winLines[cell][i]) == winLines[cell][i];
+        }
+        if (win) return 1;
+        bool lose = false;
+        for (int i = 0; i < LOSE_SLOTS; i++) {
+            lose |= (stones & loseLines[cell][i]) == loseLines[cell][i];
+        }
+        return lose ? -1 : 0;
+    }
+};
+
+template <class R>
+inline const LineTables<R> lineTables;
+
+template <class R>
+struct BasicPosition {
+    typedef typename R::Bitboard Bitboard;
+
+    Bitboard stones[2] = {0, 0};  // X, O
+
+    Bitboard occupied() const {
+        return stones[0] | stones[1];
+    }
+
+    int stoneCount() const {
+        return popCount(occupied());
+    }
+
+    int sideToMove() const {
+        return popCount(stones[0]) > popCount(stones[1]) ? 1 : 0;
+    }
+
+    bool isEmpty(int cell) const {
+        return !(occupied() & cellBitOf<R>(cell));
+    }
+
+    bool isFull() const {
+        return occupied() == R::FULL_BOARD;
+    }
+
+    // 0 for an empty cell, 1 for X, 2 for O, as in GameBoard.
+    int cellValue(int cell) const {
+        if (stones[0] & cellBitOf<R>(cell)) return 1;
+        if (stones[1] & cellBitOf<R>(cell)) return 2;
+        return 0;
+    }
+
+    void play(int cell) {
+        stones[sideToMove()] |= cellBitOf<R>(cell);
+    }
+
+    void undo(int cell) {
+        stones[0] &= ~cellBitOf<R>(cell);
+        stones[1] &= ~cellBitOf<R>(cell);
+    }
+
+    // Rule outcome of the stone on `cell` for its owner: 1 if it made four,
+    // -1 if it made a forbidden three, 0 if the game goes on.
+    int outcome(int cell) const {
+        int owner = (stones[0] & cellBitOf<R>(cell)) ? 0 : 1;
+        return lineTables<R>.outcome(stones[owner], cell);
+    }
+
+    CanonicalPosition canonical() const {
+        return canonicalizeOf<R>(stones[0], stones[1]);
+    }
+
+    // Symmetries other than the identity that leave the position unchanged.
+    int stabilizer(int syms[NUM_SYMMETRIES]) const {
+        const SymmetryTables<R>& symmetries = symmetryTables<R>;
+        int count = 0;
+        for (int s = 1; s < NUM_SYMMETRIES; s++) {
+            if (symmetries.transform(s, stones[0]) == stones[0] &&
+                symmetries.transform(s, stones[1]) == stones[1]) {
+                syms[count++] = s;
+            }
+        }
+        return count;
+    }
+};
+
+// Reads a board written row by row with 'X', 'O' and '.' (any other
+// characters, such as row separators, are skipped). Fails unless it has
+// exactly NUM_CELLS cells and stone counts that X-moves-first allows.
+template <class R>
+inline bool parsePositionOf(const std::string& text, BasicPosition<R>& position) {
+    BasicPosition<R> parsed;
+    int cell = 0;
+    for (char ch : text) {
+        if (ch != 'X' && ch != 'O' && ch != '.') continue;
+        if (cell == R::NUM_CELLS) return false;
+        if (ch == 'X') parsed.stones[0] |= cellBitOf<R>(cell);
+        if (ch == 'O') parsed.stones[1] |= cellBitOf<R>(cell);
+        cell++;
+    }
+    int x = popCount(parsed.stones[0]);
+    int o = popCount(parsed.stones[1]);
+    if (cell != R::NUM_CELLS || (x != o && x != o + 1)) {
+        return false;
+    }
+    position = parsed;
+    return true;
+}
+
+// Terms of the static evaluation, counted for one side: line windows free
+// of opponent stones that hold three, two or one of its stones, and its
+// stones in the centre. A three is bare when neither cell beyond the window
+// holds one of its stones.
+enum EvalTerm { TERM_THREE, TERM_BARE_THREE, TERM_TWO, TERM_ONE, TERM_CENTRE, TERM_COUNT };
+
+// One weight per term; a position scores the weighted term counts of the
+// side to move minus those of its opponent. The defaults are the weights the
+// evaluation was written with, including -INF for a bare three, which
+// scores the whole side -INF (a tuner replaces it with a finite weight).
+struct EvalWeights {
+    int terms[TERM_COUNT] = {50, -INF, 20, 5, 10};
+};
+
+inline const EvalWeights DEFAULT_WEIGHTS;
+
+// Fills `counts` for `side`; returns false if it has a complete winning line.
+template <class R>
+inline bool countTerms(const BasicPosition<R>& position, int side, int counts[TERM_COUNT]) {
+    const LineTables<R>& lines = lineTables<R>;
+    typename R::Bitboard mine = position.stones[side];
+    typename R::Bitboard theirs = position.stones[1 - side];
+    for (int term = 0; term < TERM_COUNT; term++) {
+        counts[term] = 0;
+    }
+
+    for (int i = 0; i < lines.windowCount; i++) {
+        const typename LineTables<R>::Window& window = lines.windows[i];
+        if (theirs & window.cells) continue;
+
+        int count = popCount(mine & window.cells);
+        if (count == R::WIN_LENGTH) {
+            return false;
+        }
+        if (count == R::LOSE_LENGTH) {
+            counts[(mine & window.ends) ? TERM_THREE : TERM_BARE_THREE]++;
+        } else if (count == 2) {
+            counts[TERM_TWO]++;
+        } else if (count == 1) {
+            counts[TERM_ONE]++;
+        }
+    }
+    counts[TERM_CENTRE] = popCount(mine & lines.centre);
+    return true;
+}
+
+// Static evaluation for one side: INF with a winning line, -INF with a bare
+// three while that weight is -INF, else the weighted term counts. Scores the
+// same terms as countTerms, window by window.
+template <class R>
+inline int evaluateSide(const BasicPosition<R>& position, int side, const EvalWeights& weights = DEFAULT_WEIGHTS) {
+    const LineTables<R>& lines = lineTables<R>;
+    typename R::Bitboard mine = position.stones[side];
+    typename R::Bitboard theirs = position.stones[1 - side];
+    const int three = weights.terms[TERM_THREE];
+    const int bareThree = weights.terms[TERM_BARE_THREE];
+    const int two = weights.terms[TERM_TWO];
+    const int one = weights.terms[TERM_ONE];
+    int score = 0;
+
+    for (int i = 0; i < lines.windowCount; i++) {
+        const typename LineTables<R>::Window& window = lines.windows[i];
+        if (theirs & window.cells) continue;
+
+        int count = popCount(mine & window.cells);
+        if (count == R::WIN_LENGTH) {
+            return INF;
+        }
+        if (count == R::LOSE_LENGTH) {
+            if (mine & window.ends) {
+                score += three;
+            } else if (bareThree <= -INF) {
+                return -INF;
+            } else {
+                score += bareThree;
+            }
+        } else if (count == 2) {
+            score += two;
+        } else if (count == 1) {
+            score += one;
+        }
+    }
+
+    return score + weights.terms[TERM_CENTRE] * popCount(mine & lines.centre);
+}
+
+template <class R>
+inline int evaluate(const BasicPosition<R>& position, const EvalWeights& weights = DEFAULT_WEIGHTS) {
+    int side = position.sideToMove();
+    return evaluateSide(position, side, weights) - evaluateSide(position, 1 - side, weights);
+}
+
+// The 5x5 game under its usual names.
+constexpr int BOARD_SIZE = DefaultRules::BOARD_SIZE;
+constexpr int WIN_LENGTH = DefaultRules::WIN_LENGTH;
+constexpr int LOSE_LENGTH = DefaultRules::LOSE_LENGTH;
+constexpr int NUM_CELLS = DefaultRules::NUM_CELLS;
+
+typedef DefaultRules::Bitboard Bitboard;
+typedef BasicPosition<DefaultRules> Position;
+
+constexpr Bitboard FULL_BOARD = DefaultRules::FULL_BOARD;
+
+inline Bitboard cellBit(int cell) {
+    return cellBitOf<DefaultRules>(cell);
+}
+
+inline const SymmetryTables<DefaultRules>& symmetries = symmetryTables<DefaultRules>;
+inline const LineTables<DefaultRules>& lines = lineTables<DefaultRules>;
+
+inline CanonicalPosition canonicalize(Bitboard x, Bitboard o) {
+    return canonicalizeOf<DefaultRules>(x, o);
+}
+
+inline bool parsePosition(const std::string& text, Position& position) {
+    return parsePositionOf(text, position);
+}
+
+enum Bound : uint8_t { BOUND_EXACT, BOUND_LOWER, BOUND_UPPER };
+
+struct TTEntry {
+    uint64_t key;
+    int score;
+    int8_t depth;    // 0 marks an empty slot, searched nodes always have depth >= 1
+    uint8_t bound;
+    int8_t move;     // best cell in canonical coordinates, -1 if none
+};
+
+// Keyed on the canonical position, so all 8 symmetric images share one entry.
+//
+// Several threads may search through one table. A slot holds the entry's
+// data packed into one word and the key XORed with that word in another;
+// both are written and read without locks, and a slot torn by two racing
+// stores fails the key check on probe, so it reads as a miss.
+class TranspositionTable {
+private:
+    struct Slot {
+        std::atomic<uint64_t> check;  // key ^ data
+        std::atomic<uint64_t> data;   // score, depth, bound, move
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    int bits;
+
+    size_t indexOf(uint64_t key) const {
+        return (key * 0x9E3779B97F4A7C15ULL) >> (64 - bits);
+    }
+
+    static uint64_t pack(int score, int depth, Bound bound, int move) {
+        return uint64_t(uint32_t(score)) | uint64_t(uint8_t(depth)) << 32 | uint64_t(uint8_t(bound)) << 40 |
+               uint64_t(uint8_t(move)) << 48;
+    }
+
+    static TTEntry unpack(uint64_t key, uint64_t data) {
+        return TTEntry{key, int(uint32_t(data)), int8_t(data >> 32), uint8_t(data >> 40), int8_t(data >> 48)};
+    }
+
+public:
+    explicit TranspositionTable(int tableBits) : slots(new Slot[size_t(1) << tableBits]), bits(tableBits) {
+        clear();
+    }
+
+    // Copies the entry for `key` into `entry`; false if there is none.
+    bool probe(uint64_t key, TTEntry& entry) const {
+        const Slot& slot = slots[indexOf(key)];
+        uint64_t data = slot.data.load(std::memory_order_relaxed);
+        uint64_t check = slot.check.load(std::memory_order_relaxed);
+        entry = unpack(check ^ data, data);
+        return entry.depth > 0 && entry.key == key;
+    }
+
+    void store(uint64_t key, int score, int depth, Bound bound, int move) {
+        Slot& slot = slots[indexOf(key)];
+        uint64_t old = slot.data.load(std::memory_order_relaxed);
+        TTEntry entry = unpack(slot.check.load(std::memory_order_relaxed) ^ old, old);
+        if (entry.key != key || depth >= entry.depth) {
+            uint64_t data = pack(score, depth, bound, move);
+            slot.data.store(data, std::memory_order_relaxed);
+            slot.check.store(key ^ data, std::memory_order_relaxed);
+        }
+    }
+
+    void clear() {
+        for (size_t i = 0; i < size_t(1) << bits; i++) {
+            slots[i].data.store(0, std::memory_order_relaxed);
+            slots[i].check.store(0, std::memory_order_relaxed);
+        }
+    }
+};
+
+struct SearchLimits {
+    int depth = 5;                               // alpha-beta: nominal depth
+    int moveTimeMs = 0;                          // 0 = no limit; otherwise deepen until time runs out
+    uint64_t nodes = 0;                          // MCTS: playouts, 0 = engine default
+    const std::atomic<bool>* stop = nullptr;     // set from another thread to abort
+    bool threats = true;                         // alpha-beta: prove forced wins with the threat solver
+    bool quiescence = true;                      // alpha-beta: play out wins and forced blocks at the horizon
+};
+
+struct SearchStats {
+    uint64_t nodes = 0;
+    uint64_t threatNodes = 0;  // positions visited by the threat solver, not counted in nodes
+    uint64_t ttHits = 0;
+    int depth = 0;           // deepest completed iteration
+    int64_t micros = 0;
+};
+
+struct SearchResult {
+    int move = -1;           // cell, -1 if there is no legal move
+    int score = 0;           // for the side to move
+    std::vector<int> pv;
+    SearchStats stats;
+    bool aborted = false;    // stopped before the first iteration completed
+};
+
+struct ScoredMove {
+    int cell;
+    int score;
+};
+
+template <class R>
+class BasicEngine {
+private:
+    typedef typename R::Bitboard Bitboard;
+    typedef BasicPosition<R> Position;
+
+    static constexpr int NUM_CELLS = R::NUM_CELLS;
+    static constexpr Bitboard FULL_BOARD = R::FULL_BOARD;
+    static inline const SymmetryTables<R>& symmetries = symmetryTables<R>;
+
+    static constexpr int SYMMETRY_DEDUP_STONES = 8;  // dedupe symmetric moves while this few stones are down
+    static constexpr int THREAT_MOVES = 12;          // longest threat sequence tried, in attacker moves
+    static constexpr int THREAT_NODES = 256;         // solver positions per call before it gives up
+    static constexpr int THREAT_MIN_DEPTH = 2;       // shallower nodes are left to the full-width search
+    static constexpr int PROVEN_DEPTH = 127;         // table depth of a solved position: no search overrides it
+    static constexpr int QUIESCENCE_PLIES = 8;       // forced blocks played out past the horizon
+
+    struct Context {
+        Position position;
+        SearchStats stats;
+        const std::atomic<bool>* stop;
+        bool hasDeadline;
+        std::chrono::steady_clock::time_point deadline;
+        bool aborted;
+        bool threats;
+        uint64_t threatBudget;  // threat solver positions left in the current call
+        bool quiescence;
+    };
+
+    TranspositionTable tt;
+    EvalWeights weights;
+    std::mutex rngMutex;                         // searches on several threads may share the engine
+    std::mt19937 rng;
+
+    bool checkAbort(Context& ctx) {
+        if (ctx.aborted) {
+            return true;
+        }
+        if (ctx.stop && ctx.stop->load(std::memory_order_relaxed)) {
+            ctx.aborted = true;
+        } else if (ctx.hasDeadline && (ctx.stats.nodes & 1023) == 0 &&
+                   std::chrono::steady_clock::now() >= ctx.deadline) {
+            ctx.aborted = true;
+        }
+        return ctx.aborted;
+    }
+
+    // Legal moves with the hash move first. In the opening the position is
+    // often symmetric; only the first cell of each orbit under its stabilizer
+    // is generated, and the stabilizer is returned for the root to expand ties.
+    int generateMoves(const Position& position, int hashMove, int moves[NUM_CELLS],
+                      int stabilizer[NUM_SYMMETRIES], int& stabilizerSize) const {
+        stabilizerSize = 0;
+        if (position.stoneCount() <= SYMMETRY_DEDUP_STONES) {
+            stabilizerSize = position.stabilizer(stabilizer);
+        }
+
+        int count = 0;
+        for (Bitboard empty = ~position.occupied() & FULL_BOARD; empty; empty &= empty - 1) {
+            int cell = lowestCell(empty);
+            bool duplicate = false;
+            for (int k = 0; k < stabilizerSize; k++) {
+                if (symmetries.cellImage[stabilizer[k]][cell] < cell) {
+                    duplicate = true;
+                    break;
+                }
+            }
+            if (duplicate) continue;
+
+            moves[count++] = cell;
+            if (cell == hashMove) {
+                std::swap(moves[0], moves[count - 1]);
+            }
+        }
+        return count;
+    }
+
+    int probeHashMove(const CanonicalPosition& canon, const TTEntry* entry) const {
+        if (!entry || entry->move < 0) {
+            return -1;
+        }
+        return symmetries.cellImage[symmetries.inverse[canon.sym]][entry->move];
+    }
+
+    // Empty cells where `side` would complete a winning line.
+    static Bitboard winningCells(const Position& position, int side) {
+        const LineTables<R>& lines = lineTables<R>;
+        Bitboard mine = position.stones[side];
+        Bitboard theirs = position.stones[1 - side];
+        Bitboard cells = 0;
+        for (int i = 0; i < lines.windowCount; i++) {
+            Bitboard window = lines.windows[i].cells;
+            if (!(theirs & window) && popCount(mine & window) == R::WIN_LENGTH - 1) {
+                cells |= window & ~mine;
+            }
+        }
+        return cells;
+    }
+
+    // Empty cells where a stone of `side` would make a new winning cell: the
+    // gaps of winning lines that hold all but two of its stones and none of
+    // the opponent's.
+    static Bitboard threatCells(const Position& position, int side) {
+        const LineTables<R>& lines = lineTables<R>;
+        Bitboard mine = position.stones[side];
+        Bitboard theirs = position.stones[1 - side];
+        Bitboard cells = 0;
+        for (int i = 0; i < lines.windowCount; i++) {
+            Bitboard window = lines.windows[i].cells;
+            if (!(theirs & window) && popCount(mine & window) == R::WIN_LENGTH - 2) {
+                cells |= window & ~mine;
+            }
+        }
+        return cells;
+    }
+
+    void storeProof(const Position& position, int score, int cell) {
+        CanonicalPosition canon = position.canonical();
+        tt.store(canon.key, score, PROVEN_DEPTH, BOUND_EXACT, symmetries.cellImage[canon.sym][cell]);
+    }
+
+    // Threat-space search for the side to move, the attacker: it only plays
+    // moves that threaten to complete a line next turn, so the defender's
+    // reply is forced - block the one winning cell, or lose to a double
+    // threat, or block on a cell that makes a forbidden three. A defender
+    // that can win at once refutes the sequence, and a winning cell it gains
+    // along the way must be blocked before the attack goes on. Returns the
+    // first move of a forced win, or -1 if none was found within
+    // `movesLeft` attacker moves and the node budget; every position on a
+    // proof goes to the table as solved.
+    int proveWin(Context& ctx, int movesLeft) {
+        Position& position = ctx.position;
+        int attacker = position.sideToMove();
+        ctx.stats.threatNodes++;
+
+        Bitboard wins = winningCells(position, attacker);
+        if (wins) {
+            return lowestCell(wins);
+        }
+        Bitboard blocks = winningCells(position, 1 - attacker);
+        if (movesLeft == 0 || ctx.threatBudget == 0 || popCount(blocks) > 1) {
+            return -1;
+        }
+        ctx.threatBudget--;
+
+        Bitboard empty = ~position.occupied() & FULL_BOARD;
+        for (Bitboard moves = (blocks ? blocks : threatCells(position, attacker)) & empty; moves;
+             moves &= moves - 1) {
+            int cell = lowestCell(moves);
+            position.play(cell);
+            bool proven = false;
+            Bitboard threats = winningCells(position, attacker);
+            if (position.outcome(cell) == 0 && threats && !position.isFull() &&
+                !winningCells(position, 1 - attacker)) {
+                if (popCount(threats) > 1) {
+                    proven = true;
+                } else {
+                    int reply = lowestCell(threats);
+                    position.play(reply);
+                    proven = position.outcome(reply) == -1 ||
+                             (!position.isFull() && proveWin(ctx, movesLeft - 1) >= 0);
+                    position.undo(reply);
+                    if (proven) storeProof(position, -INF, reply);
+                }
+            }
+            position.undo(cell);
+            if (proven) {
+                storeProof(position, INF, cell);
+                return cell;
+            }
+        }
+        return -1;
+    }
+
+    int startProof(Context& ctx) {
+        ctx.threatBudget = THREAT_NODES;
+        return proveWin(ctx, THREAT_MOVES);
+    }
+
+    // Whether the side to move, with no winning cell on the board for either
+    // side, wins with one threat: a move that makes two winning cells, or
+    // one whose only block would make a forbidden three for the opponent.
+    // proveWin one move deep, read off the line windows.
+    static bool winsWithThreat(const Position& position) {
+        const LineTables<R>& lines = lineTables<R>;
+        int side = position.sideToMove();
+        Bitboard mine = position.stones[side];
+        Bitboard theirs = position.stones[1 - side];
+        Bitboard once = 0, twice = 0;
+        for (int i = 0; i < lines.windowCount; i++) {
+            Bitboard window = lines.windows[i].cells;
+            if ((theirs & window) || popCount(mine & window) != R::WIN_LENGTH - 2) continue;
+
+            // A stone on either gap leaves the other to be blocked
+            Bitboard gaps = window & ~mine;
+            int first = lowestCell(gaps);
+            int second = lowestCell(gaps & (gaps - 1));
+            if ((lines.outcome(theirs | cellBitOf<R>(second), second) == -1 &&
+                 lines.outcome(mine | cellBitOf<R>(first), first) == 0) ||
+                (lines.outcome(theirs | cellBitOf<R>(first), first) == -1 &&
+                 lines.outcome(mine | cellBitOf<R>(second), second) == 0)) {
+                return true;
+            }
+            twice |= once & gaps;
+            once |= gaps;
+        }
+
+        for (; twice; twice &= twice - 1) {
+            int cell = lowestCell(twice);
+            Position next = position;
+            next.play(cell);
+            if (next.outcome(cell) == 0 && popCount(winningCells(next, side)) > 1) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Value of a horizon node once the forced play is over. The side to move
+    // wins with a winning cell of its own, loses to two of the opponent's,
+    // and must block a single one - losing if the block makes a forbidden
+    // three. With nothing to block it may still win with a threat. Each
+    // block is the only move, so following them for up to `pliesLeft` plies
+    // adds at most that many nodes to a leaf.
+    int quiesce(Context& ctx, int pliesLeft) {
+        Position& position = ctx.position;
+        int side = position.sideToMove();
+        if (winningCells(position, side)) {
+            return INF;
+        }
+        Bitboard blocks = winningCells(position, 1 - side);
+        if (!blocks) {
+            return winsWithThreat(position) ? INF : evaluate(position, weights);
+        }
+        if (popCount(blocks) > 1) {
+            return -INF;
+        }
+        if (pliesLeft == 0) {
+            return evaluate(position, weights);
+        }
+
+        int cell = lowestCell(blocks);
+        ctx.stats.nodes++;
+        position.play(cell);
+        int score = position.outcome(cell) == -1 ? -INF : -quiesce(ctx, pliesLeft - 1);
+        position.undo(cell);
+        return score;
+    }
+
+    // Score of the move just played on `cell` for the player who played it,
+    // searching the rest of the tree to `depth` with window (alpha, beta).
+    int scoreMove(Context& ctx, int cell, int depth, int alpha, int beta, int ply) {
+        int outcome = ctx.position.outcome(cell);
+        if (outcome == 1) return INF;
+        if (outcome == -1) return -INF;
+        return -negamax(ctx, depth - 1, -beta, -alpha, ply + 1);
+    }
+
+    int negamax(Context& ctx, int depth, int alpha, int beta, int ply) {
+        ctx.stats.nodes++;
+        if (checkAbort(ctx)) {
+            return 0;
+        }
+
+        if (depth == 0) {
+            return ctx.quiescence ? quiesce(ctx, QUIESCENCE_PLIES) : evaluate(ctx.position, weights);
+        }
+
+        CanonicalPosition canon = ctx.position.canonical();
+        int alphaOrig = alpha;
+        TTEntry stored;
+        const TTEntry* entry = tt.probe(canon.key, stored) ? &stored : nullptr;
+        if (entry && entry->depth >= depth) {
+            ctx.stats.ttHits++;
+            if (entry->bound == BOUND_EXACT) {
+                return entry->score;
+            } else if (entry->bound == BOUND_LOWER) {
+                alpha = std::max(alpha, entry->score);
+            } else {
+                beta = std::min(beta, entry->score);
+            }
+            if (beta <= alpha) {
+                return entry->score;
+            }
+        }
+
+        if (ctx.threats && depth >= THREAT_MIN_DEPTH && startProof(ctx) >= 0) {
+            return INF;
+        }
+
+        int moves[NUM_CELLS];
+        int stabilizer[NUM_SYMMETRIES];
+        int stabilizerSize;
+        int count = generateMoves(ctx.position, probeHashMove(canon, entry), moves, stabilizer, stabilizerSize);
+        if (count == 0) {
+            return evaluate(ctx.position, weights);
+        }
+
+        int best = -INF - 1;
+        int bestCell = moves[0];
+        for (int i = 0; i < count; i++) {
+            ctx.position.play(moves[i]);
+            int score = scoreMove(ctx, moves[i], depth, alpha, beta, ply);
+            ctx.position.undo(moves[i]);
+
+            if (score > best) {
+                best = score;
+                bestCell = moves[i];
+            }
+            alpha = std::max(alpha, score);
+            if (beta <= alpha) {
+                break;
+            }
+        }
+
+        if (ctx.aborted) {
+            return best;
+        }
+
+        Bound bound = BOUND_EXACT;
+        if (best <= alphaOrig) {
+            bound = BOUND_UPPER;
+        } else if (best >= beta) {
+            bound = BOUND_LOWER;
+        }
+        tt.store(canon.key, best, depth, bound, symmetries.cellImage[canon.sym][bestCell]);
+        return best;
+    }
+
+    // Full-window search of the root. Moves after the first are searched with
+    // alpha one below the best score, so every move that ties for best gets
+    // its exact score and the choice among them is uniformly random.
+    bool searchRoot(Context& ctx, int depth, int& bestCell, int& bestScore) {
+        CanonicalPosition canon = ctx.position.canonical();
+        int moves[NUM_CELLS];
+        int stabilizer[NUM_SYMMETRIES];
+        int stabilizerSize;
+        TTEntry stored;
+        int count = generateMoves(ctx.position, probeHashMove(canon, tt.probe(canon.key, stored) ? &stored : nullptr),
+                                  moves, stabilizer, stabilizerSize);
+        ctx.stats.nodes++;
+
+        std::vector<int> ties;
+        int best = -INF - 1;
+        for (int i = 0; i < count; i++) {
+            ctx.position.play(moves[i]);
+            int score = scoreMove(ctx, moves[i], depth, std::max(-INF - 1, best - 1), INF + 1, 0);
+            ctx.position.undo(moves[i]);
+            if (ctx.aborted) {
+                return false;
+            }
+
+            if (score > best) {
+                best = score;
+                ties.clear();
+            }
+            if (score == best) {
+                ties.push_back(moves[i]);
+            }
+        }
+
+        // Put back the symmetric images of tied moves that were not generated.
+        size_t searched = ties.size();
+        for (size_t m = 0; m < searched; m++) {
+            for (int k = 0; k < stabilizerSize; k++) {
+                int image = symmetries.cellImage[stabilizer[k]][ties[m]];
+                if (std::find(ties.begin(), ties.end(), image) == ties.end()) {
+                    ties.push_back(image);
+                }
+            }
+        }
+
+        std::uniform_int_distribution<size_t> dist(0, ties.size() - 1);
+        {
+            std::lock_guard<std::mutex> lock(rngMutex);
+            bestCell = ties[dist(rng)];
+        }
+        bestScore = best;
+        tt.store(canon.key, best, depth, BOUND_EXACT, symmetries.cellImage[canon.sym][bestCell]);
+        return true;
+    }
+
+    std::vector<int> principalVariation(Position position, int firstMove, int depth) const {
+        std::vector<int> pv;
+        int cell = firstMove;
+        while (cell >= 0 && int(pv.size()) < depth && position.isEmpty(cell)) {
+            pv.push_back(cell);
+            position.play(cell);
+            if (position.outcome(cell) != 0) {
+                break;
+            }
+            cell = hashMove(position);
+        }
+        return pv;
+    }
+
+public:
+    explicit BasicEngine(unsigned seed = std::random_device()(), int ttBits = 20) : tt(ttBits), rng(seed) {}
+
+    SearchResult search(const Position& position, const SearchLimits& limits) {
+        auto start = std::chrono::steady_clock::now();
+        Context ctx{position, SearchStats(), limits.stop, false, start, false, limits.threats, 0, limits.quiescence};
+        SearchResult result;
+
+        if (position.isFull()) {
+            result.score = evaluate(position, weights);
+            return result;
+        }
+
+        int proof = limits.threats ? startProof(ctx) : -1;
+        if (proof >= 0) {
+            // A forced win needs no search
+            result.move = proof;
+            result.score = INF;
+            ctx.stats.depth = limits.depth;
+        } else if (limits.moveTimeMs <= 0) {
+            result.aborted = !searchRoot(ctx, limits.depth, result.move, result.score);
+            ctx.stats.depth = result.aborted ? 0 : limits.depth;
+        } else {
+            // Iterative deepening: the first iteration always completes, later
+            // ones are abandoned when the time runs out.
+            ctx.deadline = start + std::chrono::milliseconds(limits.moveTimeMs);
+            for (int depth = 1; depth <= limits.depth; depth++) {
+                int move, score;
+                ctx.hasDeadline = depth > 1;
+                if (!searchRoot(ctx, depth, move, score)) {
+                    result.aborted = depth == 1;
+                    break;
+                }
+                result.move = move;
+                result.score = score;
+                ctx.stats.depth = depth;
+            }
+        }
+
+        if (!result.aborted) {
+            result.pv = principalVariation(position, result.move, ctx.stats.depth);
+        }
+        ctx.stats.micros = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        result.stats = ctx.stats;
+        return result;
+    }
+
+    // Exact scores for every move that ties for best, upper bounds for the
+    // rest. Meant for offline use, where all equally good moves are wanted.
+    std::vector<ScoredMove> rankMoves(const Position& position, int depth) {
+        Context ctx{position, SearchStats(), nullptr, false, std::chrono::steady_clock::now(), false, true, 0, true};
+        int stabilizer[NUM_SYMMETRIES];
+        int stabilizerSize = position.stabilizer(stabilizer);
+
+        std::vector<ScoredMove> ranked;
+        int best = -INF - 1;
+        for (Bitboard empty = ~position.occupied() & FULL_BOARD; empty; empty &= empty - 1) {
+            int cell = lowestCell(empty);
+            int representative = cell;
+            for (int k = 0; k < stabilizerSize; k++) {
+                representative = std::min(representative, symmetries.cellImage[stabilizer[k]][cell]);
+            }
+            if (representative != cell) {
+                // Same value as an image already ranked.
+                for (const auto& move : ranked) {
+                    if (move.cell == representative) {
+                        ranked.push_back({cell, move.score});
+                        break;
+                    }
+                }
+                continue;
+            }
+
+            ctx.position.play(cell);
+            int score = scoreMove(ctx, cell, depth, best - 1, INF + 1, 0);
+            ctx.position.undo(cell);
+
+            ranked.push_back({cell, score});
+            best = std::max(best, score);
+        }
+        return ranked;
+    }
+
+    // Best move the table remembers for `position`, or -1.
+    int hashMove(const Position& position) const {
+        CanonicalPosition canon = position.canonical();
+        TTEntry stored;
+        return probeHashMove(canon, tt.probe(canon.key, stored) ? &stored : nullptr);
+    }
+
+    void clear() {
+        tt.clear();
+    }
+
+    // Weights for the static evaluation; clear() the table after changing them.
+    void setWeights(const EvalWeights& evalWeights) {
+        weights = evalWeights;
+    }
+};
+
+// Compiled once, in engine.cpp, for every variant.
+extern template class BasicEngine<Rules4x4>;
+extern template class BasicEngine<Rules5x5>;
+extern template class BasicEngine<Rules6x6>;
+extern template class BasicEngine<Rules7x7>;
+
+typedef BasicEngine<DefaultRules> Engine;
@@ -0,0 +1,150 @@
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "engine.hpp"
+#include "eval_weights.hpp"
+
+// Runs the alpha-beta engine over a fixed suite of positions at every depth
+// up to a limit, with a fixed RNG seed so that moves, scores and node counts
+// are reproducible from run to run. Compare the final signature line before
+// and after an optimization to check that results did not change.
+
+#ifndef BENCH_POSITIONS
+#define BENCH_POSITIONS "bench_positions.txt"
+#endif
+
+struct BenchPosition {
+    Position position;
+    int maxDepth;
+    std::string text;
+};
+
+static std::string moveToString(int cell) {
+    if (cell < 0) return "--";
+    return std::to_string(cell / BOARD_SIZE + 1) + std::to_string(cell % BOARD_SIZE + 1);
+}
+
+static bool loadSuite(const std::string& path, int defaultDepth, std::vector<BenchPosition>& suite) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Cannot open " << path << std::endl;
+        return false;
+    }
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(in, line)) {
+        lineNumber++;
+        if (line.empty() || line[0] == '#') continue;
+
+        std::istringstream fields(line);
+        BenchPosition entry;
+        entry.maxDepth = defaultDepth;
+        fields >> entry.text >> entry.maxDepth;
+        if (!parsePosition(entry.text, entry.position)) {
+            std::cerr << path << ":" << lineNumber << ": invalid position" << std::endl;
+            return false;
+        }
+        entry.maxDepth = std::min(entry.maxDepth, defaultDepth);
+        suite.push_back(entry);
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::string path = BENCH_POSITIONS;
+    int maxDepth = 7;
+    unsigned seed = 1;
+    bool threats = true;
+    bool quiescence = true;
+    EvalWeights weights;
+
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--seed" && i + 1 < argc) {
+            seed = std::stoul(argv[++i]);
+        } else if (arg == "--no-threats") {
+            threats = false;
+        } else if (arg == "--no-quiescence") {
+            quiescence = false;
+        } else if (arg == "--weights" && i + 1 < argc) {
+            if (!loadWeights(argv[++i], weights)) {
+                std::cerr << "Cannot read weights " << argv[i] << std::endl;
+                return 1;
+            }
+        } else {
+            args.push_back(arg);
+        }
+    }
+    if (args.size() > 2) {
+        std::cerr << "Usage: " << argv[0] << " [POSITIONS_FILE] [MAX_DEPTH] [--seed N] [--no-threats] [--no-quiescence] [--weights FILE]" << std::endl;
+        return 1;
+    }
+    if (args.size() > 0) path = args[0];
+    if (args.size() > 1) maxDepth = std::stoi(args[1]);
+    if (maxDepth < 1 || maxDepth > MAX_DEPTH) {
+        std::cerr << "Depth must be between 1-" << MAX_DEPTH << std::endl;
+        return 1;
+    }
+
+    std::vector<BenchPosition> suite;
+    if (!loadSuite(path, maxDepth, suite)) {
+        return 1;
+    }
+
+    std::cout << std::setw(4) << "pos" << std::setw(6) << "depth" << std::setw(12) << "nodes"
+              << std::setw(12) << "nps" << std::setw(12) << "ttd(ms)" << std::setw(7) << "ebf"
+              << std::setw(6) << "move" << std::setw(9) << "score" << std::endl;
+
+    uint64_t totalNodes = 0;
+    uint64_t totalThreatNodes = 0;
+    int64_t totalMicros = 0;
+    uint64_t signature = 1469598103934665603ULL;
+
+    for (size_t p = 0; p < suite.size(); p++) {
+        // Each position starts from a cold table and the same seed; depths run
+        // in increasing order on a warm table, as iterative deepening would.
+        Engine engine(seed);
+        engine.setWeights(weights);
+        int64_t elapsed = 0;
+        uint64_t previousNodes = 0;
+
+        for (int depth = 1; depth <= suite[p].maxDepth; depth++) {
+            SearchLimits limits;
+            limits.depth = depth;
+            limits.threats = threats;
+            limits.quiescence = quiescence;
+            SearchResult result = engine.search(suite[p].position, limits);
+
+            elapsed += result.stats.micros;
+            totalNodes += result.stats.nodes;
+            totalThreatNodes += result.stats.threatNodes;
+            totalMicros += result.stats.micros;
+            double nps = result.stats.micros > 0 ? result.stats.nodes * 1e6 / result.stats.micros : 0.0;
+            double ebf = previousNodes > 0 ? double(result.stats.nodes) / previousNodes : 0.0;
+            previousNodes = result.stats.nodes;
+
+            for (uint64_t value : {uint64_t(result.move), uint64_t(int64_t(result.score)), result.stats.nodes}) {
+                signature = (signature ^ value) * 1099511628211ULL;
+            }
+
+            std::cout << std::setw(4) << p + 1 << std::setw(6) << depth << std::setw(12) << result.stats.nodes
+                      << std::setw(12) << uint64_t(nps) << std::setw(12) << std::fixed << std::setprecision(2)
+                      << elapsed / 1000.0 << std::setw(7) << std::setprecision(2) << ebf
+                      << std::setw(6) << moveToString(result.move) << std::setw(9) << result.score << std::endl;
+        }
+    }
+
+    std::cout << "\nPositions: " << suite.size() << "\n"
+              << "Nodes: " << totalNodes << "\n"
+              << "Threat nodes: " << totalThreatNodes << "\n"
+              << "Time (ms): " << totalMicros / 1000 << "\n"
+              << "Nodes/sec: " << (totalMicros > 0 ? uint64_t(totalNodes * 1e6 / totalMicros) : 0) << "\n"
+              << "Signature: " << std::hex << signature << std::dec << std::endl;
+    return 0;
+}
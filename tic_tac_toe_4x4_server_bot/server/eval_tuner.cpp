@@ -0,0 +1,409 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "engine.hpp"
+#include "eval_weights.hpp"
+#include "game_log.hpp"
+
+// Fits the evaluation weights to game results with Texel's method: every
+// position of a set of finished games is labelled with the game's result
+// for the side to move, 1, 0.5 or 0, and the weights are chosen to minimize
+// the mean squared difference between that label and a logistic function of
+// the static evaluation. The evaluation is linear in the weights, so each
+// position is stored once as its term counts (side to move minus opponent)
+// and the error and its gradient are sums over positions, spread over
+// threads. Positions come from server game logs, from self-play games
+// played here, or both.
+//
+// The bare-three weight is fitted like any other, so a tuned file replaces
+// the legacy -INF rule with a finite weight.
+
+struct Sample {
+    float terms[TERM_COUNT];
+    float result;
+};
+
+// Adds the positions of one game, `cells` in the order played, with the
+// result for X (1, 0.5 or 0). Positions where a side already has a winning
+// line are left out: the game was over there.
+static void addGame(const std::vector<int>& cells, double resultForX, int skipPlies, std::vector<Sample>& samples) {
+    Position position;
+    for (size_t ply = 0; ply < cells.size(); ply++) {
+        if (int(ply) >= skipPlies) {
+            int side = position.sideToMove();
+            int mine[TERM_COUNT];
+            int theirs[TERM_COUNT];
+            if (countTerms(position, side, mine) && countTerms(position, 1 - side, theirs)) {
+                Sample sample;
+                for (int term = 0; term < TERM_COUNT; term++) {
+                    sample.terms[term] = float(mine[term] - theirs[term]);
+                }
+                sample.result = float(side == 0 ? resultForX : 1.0 - resultForX);
+                samples.push_back(sample);
+            }
+        }
+        position.play(cells[ply]);
+    }
+}
+
+// Games from server logs. Games lost by an illegal move, a disconnect or
+// the clock say nothing about the position and are skipped, as are other
+// variants and records too short to hold every move.
+static size_t loadLogs(const std::vector<std::string>& paths, int skipPlies, std::vector<Sample>& samples) {
+    size_t games = 0;
+    for (const auto& path : paths) {
+        GameLogReader log(path);
+        for (const GameRecord& record : log) {
+            if (record.reason > LOG_FULL_BOARD || (record.boardSize != 0 && record.boardSize != BOARD_SIZE) ||
+                record.moveCount > GameRecord::MAX_MOVES) {
+                continue;
+            }
+            std::vector<int> cells;
+            Position position;
+            bool legal = true;
+            for (int i = 0; i < record.moveCount && legal; i++) {
+                int cell = record.moves[i];
+                legal = cell < NUM_CELLS && position.isEmpty(cell);
+                if (legal) {
+                    position.play(cell);
+                    cells.push_back(cell);
+                }
+            }
+            if (!legal) continue;
+            double result = record.result == LOG_X_WINS ? 1.0 : record.result == LOG_O_WINS ? 0.0 : 0.5;
+            addGame(cells, result, skipPlies, samples);
+            games++;
+        }
+    }
+    return games;
+}
+
+// Plays `games` engine-vs-engine games from random two-ply openings at
+// `depth` with `weights`, on `threadCount` threads.
+static void selfPlay(int games, int depth, const EvalWeights& weights, int threadCount, unsigned seed,
+                     int skipPlies, std::vector<Sample>& samples) {
+    std::atomic<int> nextGame(0);
+    std::mutex samplesMutex;
+
+    auto worker = [&](int thread) {
+        Engine engine(seed * 7919 + thread, 18);
+        engine.setWeights(weights);
+        std::mt19937 rng(seed * 104729 + thread);
+        std::vector<Sample> found;
+
+        while (nextGame.fetch_add(1) < games) {
+            engine.clear();
+            Position position;
+            std::vector<int> cells;
+            double result = 0.5;
+            while (!position.isFull()) {
+                int cell;
+                if (cells.size() < 2) {
+                    do {
+                        cell = rng() % NUM_CELLS;
+                    } while (!position.isEmpty(cell));
+                } else {
+                    SearchLimits limits;
+                    limits.depth = depth;
+                    cell = engine.search(position, limits).move;
+                }
+                int side = position.sideToMove();
+                position.play(cell);
+                cells.push_back(cell);
+                int outcome = position.outcome(cell);
+                if (outcome != 0) {
+                    result = (outcome == 1) == (side == 0) ? 1.0 : 0.0;
+                    break;
+                }
+            }
+            addGame(cells, result, skipPlies, found);
+        }
+
+        std::lock_guard<std::mutex> lock(samplesMutex);
+        samples.insert(samples.end(), found.begin(), found.end());
+    };
+
+    std::vector<std::thread> threads;
+    for (int t = 1; t < threadCount; t++) {
+        threads.emplace_back(worker, t);
+    }
+    worker(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+// Mean squared error of the samples under `weights` and scale `k`, and its
+// gradient with respect to the weights when `gradient` is not null.
+static double meanError(const std::vector<Sample>& samples, const double weights[TERM_COUNT], double k,
+                        int threadCount, double gradient[TERM_COUNT] = nullptr) {
+    std::vector<double> errors(threadCount, 0.0);
+    std::vector<std::vector<double>> gradients(threadCount, std::vector<double>(TERM_COUNT, 0.0));
+
+    auto worker = [&](int thread) {
+        size_t begin = samples.size() * thread / threadCount;
+        size_t end = samples.size() * (thread + 1) / threadCount;
+        double error = 0.0;
+        double partial[TERM_COUNT] = {};
+        for (size_t i = begin; i < end; i++) {
+            const Sample& sample = samples[i];
+            double eval = 0.0;
+            for (int term = 0; term < TERM_COUNT; term++) {
+                eval += weights[term] * sample.terms[term];
+            }
+            double predicted = 1.0 / (1.0 + std::exp(-k * eval));
+            double difference = sample.result - predicted;
+            error += difference * difference;
+            if (gradient) {
+                double slope = -2.0 * difference * predicted * (1.0 - predicted) * k;
+                for (int term = 0; term < TERM_COUNT; term++) {
+                    partial[term] += slope * sample.terms[term];
+                }
+            }
+        }
+        errors[thread] = error;
+        for (int term = 0; term < TERM_COUNT; term++) {
+            gradients[thread][term] = partial[term];
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int t = 1; t < threadCount; t++) {
+        threads.emplace_back(worker, t);
+    }
+    worker(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    double total = 0.0;
+    for (int t = 0; t < threadCount; t++) {
+        total += errors[t];
+    }
+    if (gradient) {
+        for (int term = 0; term < TERM_COUNT; term++) {
+            gradient[term] = 0.0;
+            for (int t = 0; t < threadCount; t++) {
+                gradient[term] += gradients[t][term];
+            }
+            gradient[term] /= samples.size();
+        }
+    }
+    return total / samples.size();
+}
+
+const double MIN_SCALE = 1e-6;
+const double MAX_SCALE = 1.0;
+
+// Scale that best maps the starting evaluation to results, by golden-section
+// search over log(k) between MIN_SCALE and MAX_SCALE. `atBound` is set when
+// the best scale is at either end: at the low end the evaluation predicts
+// results no better than a draw for every position does, or worse.
+static double fitScale(const std::vector<Sample>& samples, const double weights[TERM_COUNT], int threadCount,
+                       bool& atBound) {
+    const double ratio = (std::sqrt(5.0) - 1.0) / 2.0;
+    double low = std::log(MIN_SCALE);
+    double high = std::log(MAX_SCALE);
+    for (int i = 0; i < 40; i++) {
+        double a = high - ratio * (high - low);
+        double b = low + ratio * (high - low);
+        if (meanError(samples, weights, std::exp(a), threadCount) < meanError(samples, weights, std::exp(b), threadCount)) {
+            high = b;
+        } else {
+            low = a;
+        }
+    }
+    double k = std::exp((low + high) / 2.0);
+    atBound = k < 2.0 * MIN_SCALE || k > MAX_SCALE / 2.0;
+    return k;
+}
+
+static void usage(const char* program) {
+    std::cerr << "Usage: " << program << " [LOG_FILE...] [options]\n"
+              << "  --self-play N     also play N engine games for positions (default 0)\n"
+              << "  --depth D         self-play search depth (default 4)\n"
+              << "  --weights FILE    starting weights, also used in self-play (default: built in)\n"
+              << "  --out FILE        where to write the fitted weights (default weights.txt)\n"
+              << "  --iterations N    gradient steps (default 2000)\n"
+              << "  --skip-plies N    leave out the first N positions of every game (default 2)\n"
+              << "  --threads N       threads for self-play and fitting (default: all cores)\n"
+              << "  --seed N          self-play seed (default 1)" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> logs;
+    int selfPlayGames = 0;
+    int depth = 4;
+    std::string weightsPath;
+    std::string outPath = "weights.txt";
+    int iterations = 2000;
+    int skipPlies = 2;
+    int threadCount = std::max(1u, std::thread::hardware_concurrency());
+    unsigned seed = 1;
+
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "--self-play" && hasValue) {
+                selfPlayGames = std::stoi(argv[++i]);
+            } else if (arg == "--depth" && hasValue) {
+                depth = std::stoi(argv[++i]);
+            } else if (arg == "--weights" && hasValue) {
+                weightsPath = argv[++i];
+            } else if (arg == "--out" && hasValue) {
+                outPath = argv[++i];
+            } else if (arg == "--iterations" && hasValue) {
+                iterations = std::stoi(argv[++i]);
+            } else if (arg == "--skip-plies" && hasValue) {
+                skipPlies = std::stoi(argv[++i]);
+            } else if (arg == "--threads" && hasValue) {
+                threadCount = std::stoi(argv[++i]);
+            } else if (arg == "--seed" && hasValue) {
+                seed = std::stoul(argv[++i]);
+            } else if (arg.compare(0, 2, "--") == 0) {
+                usage(argv[0]);
+                return 1;
+            } else {
+                logs.push_back(arg);
+            }
+        }
+    } catch (const std::exception& e) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if ((logs.empty() && selfPlayGames <= 0) || depth < 1 || depth > MAX_DEPTH || iterations < 0 ||
+        skipPlies < 0 || threadCount < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    EvalWeights start;
+    if (!weightsPath.empty() && !loadWeights(weightsPath, start)) {
+        std::cerr << "Cannot read weights " << weightsPath << std::endl;
+        return 1;
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<Sample> samples;
+    try {
+        if (!logs.empty()) {
+            size_t games = loadLogs(logs, skipPlies, samples);
+            std::cout << "Logs: " << games << " games, " << samples.size() << " positions" << std::endl;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    if (selfPlayGames > 0) {
+        size_t before = samples.size();
+        selfPlay(selfPlayGames, depth, start, threadCount, seed, skipPlies, samples);
+        std::cout << "Self-play: " << selfPlayGames << " games at depth " << depth << ", "
+                  << samples.size() - before << " positions" << std::endl;
+    }
+    if (samples.empty()) {
+        std::cerr << "No positions to fit" << std::endl;
+        return 1;
+    }
+
+    // A -INF weight has no gradient; the fit starts a bare three at zero.
+    // Terms no position has keep their starting weight.
+    bool seen[TERM_COUNT] = {};
+    for (const Sample& sample : samples) {
+        for (int term = 0; term < TERM_COUNT; term++) {
+            seen[term] = seen[term] || sample.terms[term] != 0.0f;
+        }
+    }
+    double weights[TERM_COUNT];
+    double startNorm = 0.0;
+    for (int term = 0; term < TERM_COUNT; term++) {
+        weights[term] = start.terms[term] <= -INF ? 0.0 : start.terms[term];
+        if (seen[term]) startNorm += weights[term] * weights[term];
+    }
+    bool atBound;
+    double k = fitScale(samples, weights, threadCount, atBound);
+    bool fromZero = atBound && k < 1.0;
+    if (fromZero) {
+        // Scaled down to nothing: the descent starts from zero weights
+        std::cerr << "Warning: the starting weights do not predict these results (best scale is the " << MIN_SCALE
+                  << " bound); fitting from zero weights" << std::endl;
+        for (int term = 0; term < TERM_COUNT; term++) {
+            weights[term] = 0.0;
+        }
+        k = 1.0;
+    } else if (atBound) {
+        std::cerr << "Warning: best scale for the starting weights is the " << MAX_SCALE << " bound" << std::endl;
+    }
+    double initialError = meanError(samples, weights, k, threadCount);
+    std::cout << "Starting error " << std::setprecision(6) << initialError;
+    if (fromZero) {
+        std::cout << " (zero weights)" << std::endl;
+    } else {
+        std::cout << " at scale " << std::setprecision(4) << k << std::endl;
+    }
+
+    // Only the product of the scale and the weights matters, so the descent
+    // runs at scale 1 on weights in units of log-odds, with Adam
+    const double rate = 0.01, beta1 = 0.9, beta2 = 0.999, epsilon = 1e-12;
+    double moment[TERM_COUNT] = {};
+    double velocity[TERM_COUNT] = {};
+    for (int term = 0; term < TERM_COUNT; term++) {
+        weights[term] *= k;
+    }
+    for (int step = 1; step <= iterations; step++) {
+        double gradient[TERM_COUNT];
+        double error = meanError(samples, weights, 1.0, threadCount, gradient);
+        for (int term = 0; term < TERM_COUNT; term++) {
+            moment[term] = beta1 * moment[term] + (1 - beta1) * gradient[term];
+            velocity[term] = beta2 * velocity[term] + (1 - beta2) * gradient[term] * gradient[term];
+            double corrected = moment[term] / (1 - std::pow(beta1, step));
+            double scale = std::sqrt(velocity[term] / (1 - std::pow(beta2, step))) + epsilon;
+            weights[term] -= rate * corrected / scale;
+        }
+        if (step % 200 == 0) {
+            std::cerr << "\rStep " << step << ": error " << std::setprecision(6) << error << std::flush;
+        }
+    }
+    if (iterations >= 200) std::cerr << "\r" << std::string(40, ' ') << "\r";
+
+    // The fit fixes the weights only up to a common factor; they are written
+    // in the units of the starting weights, with the same length over the
+    // terms the positions have
+    double norm = 0.0;
+    for (int term = 0; term < TERM_COUNT; term++) {
+        if (seen[term]) norm += weights[term] * weights[term];
+    }
+    k = norm > 0.0 && startNorm > 0.0 ? std::sqrt(norm / startNorm) : 1.0;
+    EvalWeights fitted = start;
+    for (int term = 0; term < TERM_COUNT; term++) {
+        if (seen[term]) fitted.terms[term] = int(std::lround(weights[term] / k));
+        weights[term] = fitted.terms[term] <= -INF ? 0.0 : fitted.terms[term];
+    }
+    double finalError = meanError(samples, weights, k, threadCount);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    std::cout << "Fitted error " << std::setprecision(6) << finalError << " on " << samples.size()
+              << " positions in " << std::fixed << std::setprecision(1) << seconds << " s\n";
+    for (int term = 0; term < TERM_COUNT; term++) {
+        std::cout << "  " << std::left << std::setw(12) << EVAL_TERM_NAMES[term] << std::right << std::setw(6)
+                  << fitted.terms[term] << (seen[term] ? "" : "  (not seen, kept)") << "\n";
+    }
+    std::ostringstream comment;
+    comment << "fitted to " << samples.size() << " positions, error " << std::setprecision(6) << finalError;
+    if (!saveWeights(outPath, fitted, comment.str())) {
+        std::cerr << "Cannot write " << outPath << std::endl;
+        return 1;
+    }
+    std::cout << "Wrote " << outPath << std::endl;
+    return 0;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <fstream>
+#include <sstream>
+#include <string>
+#include "engine.hpp"
+
+// Evaluation weights as text, one "name value" pair per line; '#' starts a
+// comment. Terms a file leaves out keep their default weight, and "-inf"
+// gives a bare three the legacy rule that it scores the side -INF.
+
+inline const char* const EVAL_TERM_NAMES[TERM_COUNT] = {"three", "bare_three", "two", "one", "centre"};
+
+inline bool loadWeights(const std::string& path, EvalWeights& weights) {
+    std::ifstream in(path);
+    if (!in) {
+        return false;
+    }
+    EvalWeights loaded;
+    std::string line;
+    while (std::getline(in, line)) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::string name, value;
+        if (!(fields >> name)) continue;
+        if (!(fields >> value)) return false;
+
+        int term = 0;
+        while (term < TERM_COUNT && name != EVAL_TERM_NAMES[term]) term++;
+        if (term == TERM_COUNT) return false;
+        try {
+            loaded.terms[term] = value == "-inf" ? -INF : std::stoi(value);
+        } catch (const std::exception&) {
+            return false;
+        }
+    }
+    weights = loaded;
+    return true;
+}
+
+inline bool saveWeights(const std::string& path, const EvalWeights& weights, const std::string& comment = "") {
+    std::ofstream out(path);
+    if (!comment.empty()) {
+        out << "# " << comment << "\n";
+    }
+    for (int term = 0; term < TERM_COUNT; term++) {
+        out << EVAL_TERM_NAMES[term] << " ";
+        if (weights.terms[term] <= -INF) {
+            out << "-inf\n";
+        } else {
+            out << weights.terms[term] << "\n";
+        }
+    }
+    return bool(out);
+}
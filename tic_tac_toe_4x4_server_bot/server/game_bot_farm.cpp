@@ -0,0 +1,519 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include "engine.hpp"
+#include "protocol.hpp"
+#include "transport.hpp"
+
+// Bot farm: one process plays many games at once against the server. The
+// connections share one event loop, and every game is searched by one
+// Engine on a pool of worker threads, so all games share its transposition
+// table and a game costs a connection and a position rather than a process.
+// Everything that holds a position is compiled for the variant's Rules.
+
+using Clock = std::chrono::steady_clock;
+
+// One connection, for one game.
+template <class R>
+struct Session {
+    enum State { CONNECTING, AWAIT_WELCOME, AWAIT_TURN, THINKING };
+
+    int fd;
+    uint64_t id;               // tells a finished search which connection it was for
+    State state;
+    int playerType;            // 1 = X, 2 = O, 0 until the server has said
+    BasicPosition<R> position;
+    FrameReader input;
+    std::string output;
+    bool wantWrite;
+
+    Session(int socket, uint64_t sessionId, int type)
+        : fd(socket), id(sessionId), state(CONNECTING), playerType(type), position(), input(3), wantWrite(true) {}
+};
+
+template <class R>
+struct SearchJob {
+    uint64_t session;
+    int fd;
+    BasicPosition<R> position;
+};
+
+struct SearchDone {
+    uint64_t session;
+    int fd;
+    int move;
+    uint64_t nodes;
+    int64_t micros;
+};
+
+// Worker threads that search positions for every session with the same
+// engine. Finished searches are collected for the event loop, which is
+// woken through an eventfd.
+template <class R>
+class SearchPool {
+private:
+    BasicEngine<R>& engine;
+    SearchLimits limits;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::deque<SearchJob<R>> jobs;
+    std::vector<SearchDone> finished;
+    bool stopping;
+    int doneEvent;
+    std::vector<std::thread> threads;
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wakeup.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (stopping) return;
+            SearchJob<R> job = jobs.front();
+            jobs.pop_front();
+            lock.unlock();
+
+            SearchResult result = engine.search(job.position, limits);
+
+            lock.lock();
+            finished.push_back(SearchDone{job.session, job.fd, result.move, result.stats.nodes, result.stats.micros});
+            uint64_t one = 1;
+            ssize_t ignored = write(doneEvent, &one, sizeof(one));
+            (void)ignored;
+        }
+    }
+
+public:
+    SearchPool(BasicEngine<R>& sharedEngine, const SearchLimits& searchLimits, int threadCount)
+        : engine(sharedEngine), limits(searchLimits), stopping(false) {
+        doneEvent = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (doneEvent < 0) {
+            throw std::runtime_error("Failed to create search event");
+        }
+        for (int i = 0; i < threadCount; i++) {
+            threads.emplace_back(&SearchPool::run, this);
+        }
+    }
+
+    ~SearchPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeup.notify_all();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        close(doneEvent);
+    }
+
+    // Readable when searches have finished.
+    int completions() const {
+        return doneEvent;
+    }
+
+    void submit(const SearchJob<R>& job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(job);
+        }
+        wakeup.notify_one();
+    }
+
+    std::vector<SearchDone> takeFinished() {
+        uint64_t value;
+        ssize_t ignored = read(doneEvent, &value, sizeof(value));
+        (void)ignored;
+        std::vector<SearchDone> taken;
+        std::lock_guard<std::mutex> lock(mutex);
+        taken.swap(finished);
+        return taken;
+    }
+};
+
+struct FarmStats {
+    uint64_t results[6] = {};  // by result code / 100
+    uint64_t connectErrors = 0;
+    uint64_t disconnects = 0;
+    uint64_t protocolErrors = 0;
+    uint64_t searches = 0;
+    uint64_t nodes = 0;
+    int64_t searchMicros = 0;
+};
+
+template <class R>
+class BotFarm {
+private:
+    static const int MAX_EVENTS = 1024;
+    static constexpr int BOARD_SIZE = R::BOARD_SIZE;
+
+    std::string address;
+    int port;
+    int playerType;
+    std::string playerName;
+    SearchPool<R>& pool;
+    int epollFd;
+    std::vector<std::unique_ptr<Session<R>>> sessions;  // indexed by fd
+    size_t openSessions;
+    uint64_t nextSessionId;
+    FarmStats stats;
+
+public:
+    BotFarm(const std::string& serverAddress, int serverPort, int type, const std::string& name,
+           SearchPool<R>& searches)
+        : address(serverAddress), port(serverPort), playerType(type), playerName(name), pool(searches),
+          openSessions(0), nextSessionId(1) {
+        epollFd = epoll_create1(0);
+        if (epollFd < 0) {
+            throw std::runtime_error("Failed to create epoll instance");
+        }
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = pool.completions();
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, pool.completions(), &event);
+    }
+
+    ~BotFarm() {
+        for (auto& session : sessions) {
+            if (session) close(session->fd);
+        }
+        close(epollFd);
+    }
+
+    size_t open() const {
+        return openSessions;
+    }
+
+    const FarmStats& results() const {
+        return stats;
+    }
+
+    uint64_t gamesFinished() const {
+        uint64_t finished = 0;
+        for (uint64_t count : stats.results) finished += count;
+        return finished;
+    }
+
+    void startSession() {
+        int fd = connectTo(address, port, true);
+        if (fd < 0) {
+            stats.connectErrors++;
+            return;
+        }
+        if (fd >= int(sessions.size())) {
+            sessions.resize(fd + 1);
+        }
+        sessions[fd].reset(new Session<R>(fd, nextSessionId++, playerType));
+        openSessions++;
+
+        struct epoll_event event = {};
+        event.events = EPOLLIN | EPOLLOUT;
+        event.data.fd = fd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+    }
+
+    void poll(int timeoutMs) {
+        struct epoll_event events[MAX_EVENTS];
+        int count = epoll_wait(epollFd, events, MAX_EVENTS, timeoutMs);
+        for (int i = 0; i < count; i++) {
+            int fd = events[i].data.fd;
+            if (fd == pool.completions()) {
+                for (const SearchDone& done : pool.takeFinished()) {
+                    playSearchedMove(done);
+                }
+                continue;
+            }
+            Session<R>* session = sessionFor(fd);
+            if (session && (events[i].events & EPOLLOUT)) {
+                handleWritable(session);
+            }
+            session = sessionFor(fd);
+            if (session && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+                handleReadable(session);
+            }
+        }
+    }
+
+private:
+    Session<R>* sessionFor(int fd) {
+        return fd >= 0 && fd < int(sessions.size()) ? sessions[fd].get() : nullptr;
+    }
+
+    void handleWritable(Session<R>* session) {
+        if (session->state == Session<R>::CONNECTING) {
+            int error = 0;
+            socklen_t length = sizeof(error);
+            getsockopt(session->fd, SOL_SOCKET, SO_ERROR, &error, &length);
+            if (error != 0) {
+                stats.connectErrors++;
+                closeSession(session);
+                return;
+            }
+            session->state = Session<R>::AWAIT_WELCOME;
+        }
+        flush(session);
+    }
+
+    void handleReadable(Session<R>* session) {
+        int fd = session->fd;
+        ssize_t received = session->input.fill(fd);
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            return;
+        }
+        if (received <= 0) {
+            stats.disconnects++;
+            closeSession(session);
+            return;
+        }
+
+        std::string_view message;
+        while (sessionFor(fd) == session && session->input.next(message)) {
+            handleMessage(session, message);
+        }
+    }
+
+    void handleMessage(Session<R>* session, std::string_view message) {
+        int code = 0;
+        for (char c : message) {
+            if (c < '0' || c > '9') {
+                stats.protocolErrors++;
+                closeSession(session);
+                return;
+            }
+            code = code * 10 + (c - '0');
+        }
+
+        if (session->state == Session<R>::CONNECTING || session->state == Session<R>::AWAIT_WELCOME) {
+            if (code != 700) {
+                stats.protocolErrors++;
+                closeSession(session);
+                return;
+            }
+            send(session, std::to_string(session->playerType) + " " + playerName);
+            session->state = Session<R>::AWAIT_TURN;
+            return;
+        }
+
+        int statusCode = code / 100;
+        int moveCode = code % 100;
+        if (statusCode >= 1 && statusCode <= 5) {
+            stats.results[statusCode]++;
+            closeSession(session);
+            return;
+        }
+        if ((statusCode != 0 && statusCode != 6) || session->state != Session<R>::AWAIT_TURN) {
+            stats.protocolErrors++;
+            closeSession(session);
+            return;
+        }
+
+        // A player that asked for any side learns it from the first message
+        if (session->playerType == 0) {
+            session->playerType = statusCode == 6 ? 1 : 2;
+        }
+        if (moveCode != 0) {
+            int row = moveCode / 10 - 1;
+            int col = moveCode % 10 - 1;
+            if (row < 0 || row >= BOARD_SIZE || col < 0 || col >= BOARD_SIZE ||
+                !session->position.isEmpty(row * BOARD_SIZE + col)) {
+                stats.protocolErrors++;
+                closeSession(session);
+                return;
+            }
+            session->position.play(row * BOARD_SIZE + col);
+        }
+
+        session->state = Session<R>::THINKING;
+        pool.submit(SearchJob<R>{session->id, session->fd, session->position});
+    }
+
+    // A search has finished; its session may have gone since.
+    void playSearchedMove(const SearchDone& done) {
+        stats.searches++;
+        stats.nodes += done.nodes;
+        stats.searchMicros += done.micros;
+
+        Session<R>* session = sessionFor(done.fd);
+        if (!session || session->id != done.session || session->state != Session<R>::THINKING) {
+            return;
+        }
+        if (done.move < 0) {
+            stats.protocolErrors++;
+            closeSession(session);
+            return;
+        }
+        session->position.play(done.move);
+        session->state = Session<R>::AWAIT_TURN;
+        send(session, std::to_string((done.move / BOARD_SIZE + 1) * 10 + done.move % BOARD_SIZE + 1));
+    }
+
+    void send(Session<R>* session, const std::string& message) {
+        appendFrame(session->output, message);
+        flush(session);
+    }
+
+    void flush(Session<R>* session) {
+        while (!session->output.empty()) {
+            ssize_t sent = ::send(session->fd, session->output.data(), session->output.size(), MSG_NOSIGNAL);
+            if (sent < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                session->output.clear();  // the read side reports the disconnect
+                break;
+            }
+            session->output.erase(0, sent);
+        }
+
+        bool wantWrite = !session->output.empty();
+        if (wantWrite != session->wantWrite) {
+            struct epoll_event event = {};
+            event.events = wantWrite ? EPOLLIN | EPOLLOUT : EPOLLIN;
+            event.data.fd = session->fd;
+            epoll_ctl(epollFd, EPOLL_CTL_MOD, session->fd, &event);
+            session->wantWrite = wantWrite;
+        }
+    }
+
+    void closeSession(Session<R>* session) {
+        int fd = session->fd;
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+        sessions[fd].reset();
+        openSessions--;
+    }
+};
+
+static void raiseFileLimit() {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    size_t sessionCount = 100;
+    uint64_t games = 0;
+    double duration = 0;
+    int playerType = 0;
+    std::string name = "farm";
+    SearchLimits limits;
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    int ttBits = 22;
+    int variant = DEFAULT_VARIANT;
+
+    std::vector<std::string> args;
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "--sessions" && hasValue) sessionCount = std::stoul(argv[++i]);
+            else if (arg == "--games" && hasValue) games = std::stoull(argv[++i]);
+            else if (arg == "--duration" && hasValue) duration = std::stod(argv[++i]);
+            else if (arg == "--side" && hasValue) playerType = std::stoi(argv[++i]);
+            else if (arg == "--name" && hasValue) name = argv[++i];
+            else if (arg == "--depth" && hasValue) limits.depth = std::stoi(argv[++i]);
+            else if (arg == "--movetime" && hasValue) limits.moveTimeMs = std::stoi(argv[++i]);
+            else if (arg == "--threads" && hasValue) threads = std::stoi(argv[++i]);
+            else if (arg == "--tt-bits" && hasValue) ttBits = std::stoi(argv[++i]);
+            else if (arg == "--variant" && hasValue) variant = findVariant(argv[++i]);
+            else args.push_back(arg);
+        }
+    } catch (const std::exception& e) {
+        args.clear();
+    }
+    if (args.size() != 2 || sessionCount < 1 || playerType < 0 || playerType > 2 || limits.depth < 1 ||
+        limits.depth > MAX_DEPTH || limits.moveTimeMs < 0 || threads < 1 || ttBits < 10 || ttBits > 30 ||
+        variant < 0 || name.empty() || name.find_first_of(" \n") != std::string::npos) {
+        std::cerr << "Usage: " << argv[0] << " <IP|unix:PATH> <PORT> [options]\n"
+                  << "  --sessions N     games played at once (default 100)\n"
+                  << "  --games N        stop after N games (default: no limit)\n"
+                  << "  --duration S     stop after S seconds (default: no limit)\n"
+                  << "  --side 0|1|2     side asked for: any (default), X or O\n"
+                  << "  --name NAME      player name of every session (default farm)\n"
+                  << "  --depth D        search depth, 1-10 (default 5)\n"
+                  << "  --movetime MS    deepen up to D until MS per move (default: fixed depth)\n"
+                  << "  --threads N      search threads (default: one per core)\n"
+                  << "  --tt-bits B      shared transposition table of 2^B entries (default 22)\n"
+                  << "  --variant NAME   board the server plays: " << VARIANT_NAMES << " (default "
+                  << VARIANTS[DEFAULT_VARIANT].name << ")\n";
+        return 1;
+    }
+
+    raiseFileLimit();
+    try {
+        withVariant(variant, [&](auto rules) {
+            typedef decltype(rules) R;
+            BasicEngine<R> engine(std::random_device{}(), ttBits);
+            SearchPool<R> pool(engine, limits, threads);
+            BotFarm<R> farm(args[0], std::stoi(args[1]), playerType, name, pool);
+            auto start = Clock::now();
+            auto lastReport = start;
+            uint64_t reportedGames = 0;
+            uint64_t reportedSearches = 0;
+            int64_t reportedMicros = 0;
+
+            while (true) {
+                auto now = Clock::now();
+                double elapsed = std::chrono::duration<double>(now - start).count();
+                uint64_t finished = farm.gamesFinished();
+                if ((duration > 0 && elapsed >= duration) || (games > 0 && finished >= games)) {
+                    break;
+                }
+
+                // Keep the sessions up, but start no more games than asked for
+                uint64_t wanted = sessionCount;
+                if (games > 0) wanted = std::min<uint64_t>(wanted, games - finished);
+                for (size_t open = farm.open(); open < wanted; open++) {
+                    farm.startSession();
+                }
+
+                farm.poll(100);
+
+                if (now - lastReport >= std::chrono::seconds(1)) {
+                    const FarmStats& stats = farm.results();
+                    double interval = std::chrono::duration<double>(now - lastReport).count();
+                    uint64_t searches = stats.searches - reportedSearches;
+                    std::cerr << std::fixed << std::setprecision(1) << elapsed << "s: "
+                              << (finished - reportedGames) / interval << " games/sec, " << farm.open() << " open, "
+                              << searches / interval << " searches/sec, "
+                              << (searches > 0 ? (stats.searchMicros - reportedMicros) / searches : 0)
+                              << " us/search" << std::endl;
+                    reportedGames = finished;
+                    reportedSearches = stats.searches;
+                    reportedMicros = stats.searchMicros;
+                    lastReport = now;
+                }
+            }
+
+            double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            const FarmStats& stats = farm.results();
+            uint64_t finished = farm.gamesFinished();
+            std::cout << "\nGames: " << finished << " in " << std::fixed << std::setprecision(1) << seconds
+                      << " s (" << finished / seconds << " games/sec)\n"
+                      << "Searches: " << stats.searches << ", " << stats.nodes << " nodes, "
+                      << (stats.searches > 0 ? stats.searchMicros / int64_t(stats.searches) : 0) << " us/search\n"
+                      << "Results: " << stats.results[1] << " won, " << stats.results[2] << " lost, "
+                      << stats.results[3] << " draw, " << stats.results[4] << " won by error, "
+                      << stats.results[5] << " lost by error\n"
+                      << "Errors: " << stats.connectErrors << " connect, " << stats.disconnects << " disconnect, "
+                      << stats.protocolErrors << " protocol" << std::endl;
+        });
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -2,18 +2,21 @@
 #include <string>
 #include <cstring>
 #include <unistd.h>
-#include <arpa/inet.h>
+#include <vector>
 #include "board.hpp"
+#include "protocol.hpp"
+#include "transport.hpp"
 
 class GameClient {
 private:
     int socket;
+    FrameReader input;  // server codes are three digits
     GameBoard board;
     int playerType;
 
 public:
-    GameClient(const std::string& ip, int port, int playerType, const std::string& name)
-        : playerType(playerType) {
+    GameClient(const std::string& ip, int port, int playerType, const std::string& name, int variant)
+        : input(3), board(variant), playerType(playerType) {
         connectToServer(ip, port);
         authenticate(playerType, name);
         playGame();
@@ -24,18 +27,9 @@ public:
     }
 
 private:
-    void connectToServer(const std::string& ip, int port) {
-        socket = ::socket(AF_INET, SOCK_STREAM, 0);
+    void connectToServer(const std::string& address, int port) {
+        socket = connectTo(address, port);
         if (socket < 0) {
-            throw std::runtime_error("Failed to create socket");
-        }
-
-        struct sockaddr_in serverAddr;
-        serverAddr.sin_family = AF_INET;
-        serverAddr.sin_port = htons(port);
-        serverAddr.sin_addr.s_addr = inet_addr(ip.c_str());
-
-        if (connect(socket, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) < 0) {
             throw std::runtime_error("Connection failed");
         }
 
@@ -53,6 +47,7 @@ private:
     void playGame() {
         board.reset();
         bool gameEnded = false;
+        bool sideKnown = false;
 
         while (!gameEnded) {
             std::string serverMsg = receiveMessage();
@@ -62,6 +57,13 @@ private:
             int moveCode = code % 100;
             int statusCode = code / 100;
 
+            // The lobby may seat us on either side, whatever we asked for:
+            // 600 means X, an opponent move first means O
+            if (!sideKnown && (statusCode == 0 || statusCode == 6)) {
+                sideKnown = true;
+                playerType = statusCode == 6 ? 1 : 2;
+            }
+
             if (moveCode != 0) {
                 board.placeMove(moveCode, 3 - playerType);
                 board.display();
@@ -100,32 +102,44 @@ private:
     }
 
     void sendMessage(const std::string& message) {
-        if (send(socket, message.c_str(), message.length(), 0) < 0) {
+        if (!sendFrame(socket, message)) {
             throw std::runtime_error("Failed to send message");
         }
     }
 
     std::string receiveMessage() {
-        char buffer[16] = {0};
-        if (recv(socket, buffer, sizeof(buffer), 0) < 0) {
+        std::string_view message;
+        if (!input.receive(socket, message)) {
             throw std::runtime_error("Failed to receive message");
         }
-        return std::string(buffer);
+        return std::string(message);
     }
 };
 
 int main(int argc, char *argv[]) {
-    if (argc != 5) {
-        std::cerr << "Usage: " << argv[0] << " <IP> <PORT> <PLAYER_TYPE> <NAME>\n";
+    int variant = DEFAULT_VARIANT;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--variant" && i + 1 < argc) {
+            variant = findVariant(argv[++i]);
+        } else {
+            args.push_back(arg);
+        }
+    }
+    if (args.size() != 4 || variant < 0) {
+        std::cerr << "Usage: " << argv[0] << " <IP|unix:PATH> <PORT> <PLAYER_TYPE> <NAME> [--variant NAME]\n";
+        std::cerr << "  variants: " << VARIANT_NAMES << "\n";
         return 1;
     }
 
     try {
         GameClient client(
-            argv[1],
-            std::stoi(argv[2]),
-            std::stoi(argv[3]),
-            argv[4]
+            args[0],
+            std::stoi(args[1]),
+            std::stoi(args[2]),
+            args[3],
+            variant
         );
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << "\n";
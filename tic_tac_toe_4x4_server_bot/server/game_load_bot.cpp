@@ -0,0 +1,555 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include "latency_histogram.hpp"
+#include "protocol.hpp"
+#include "shm_channel.hpp"
+#include "transport.hpp"
+#include "variants.hpp"
+
+// Load generator for game_server: keeps many random-move players connected
+// from one process over non-blocking sockets, starts games at a given rate
+// and measures how long the server takes to answer.
+
+using Clock = std::chrono::steady_clock;
+
+static uint64_t microsBetween(Clock::time_point from, Clock::time_point to) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(to - from).count();
+}
+
+// One simulated player, for one game.
+struct Bot {
+    enum State { CONNECTING, AWAIT_WELCOME, AWAIT_CHANNEL, AWAIT_START, PLAYING };
+
+    int fd;
+    State state;
+    int playerType;
+    uint64_t occupied;         // cells taken by either side, bit row * size + col
+    FrameReader input;
+    std::string output;
+    bool wantWrite;
+    std::unique_ptr<ShmChannel> channel;  // with --shm, once the server has granted it
+    Clock::time_point sentAt;  // connect, hello or last move
+
+    Bot(int socket, int type)
+        : fd(socket), state(CONNECTING), playerType(type), occupied(0), input(3), wantWrite(true),
+          sentAt(Clock::now()) {}
+};
+
+struct LoadStats {
+    LatencyHistogram connect;  // connect until the welcome
+    LatencyHistogram pairing;  // hello until the first move or start signal
+    LatencyHistogram move;     // our move until the next message
+    uint64_t results[6] = {};  // by result code / 100
+    uint64_t connectErrors = 0;
+    uint64_t disconnects = 0;
+    uint64_t protocolErrors = 0;
+    uint64_t timeouts = 0;
+};
+
+class LoadGenerator {
+private:
+    static const int MAX_EVENTS = 1024;
+    static const int CHANNEL_ACTIVE_MS = 5;  // channels are polled before sleeping while this recently used
+    static constexpr uint64_t DOORBELL = uint64_t(1) << 32;  // epoll data of a doorbell: bot fd | DOORBELL
+
+    std::string address;
+    int port;
+    int boardSize;
+    bool sharedMemory;
+    int epollFd;
+    std::vector<std::unique_ptr<Bot>> bots;  // indexed by fd
+    std::vector<int> channelBots;            // fds of bots on shared memory
+    Clock::time_point channelActivity;
+    size_t openBots;
+    uint64_t startedBots;
+    std::mt19937 rng;
+    LoadStats stats;
+
+public:
+    LoadGenerator(const std::string& serverAddress, int serverPort, int size, bool useSharedMemory)
+        : address(serverAddress), port(serverPort), boardSize(size), sharedMemory(useSharedMemory), openBots(0),
+          startedBots(0),
+          rng(std::random_device()()) {
+        epollFd = epoll_create1(0);
+        if (epollFd < 0) {
+            throw std::runtime_error("Failed to create epoll instance");
+        }
+    }
+
+    ~LoadGenerator() {
+        for (auto& bot : bots) {
+            if (bot) close(bot->fd);
+        }
+        close(epollFd);
+    }
+
+    size_t open() const {
+        return openBots;
+    }
+
+    uint64_t started() const {
+        return startedBots;
+    }
+
+    const LoadStats& results() const {
+        return stats;
+    }
+
+    uint64_t gamesFinished() const {
+        uint64_t finished = 0;
+        for (uint64_t count : stats.results) finished += count;
+        return finished / 2;
+    }
+
+    uint64_t errors() const {
+        return stats.connectErrors + stats.disconnects + stats.protocolErrors + stats.timeouts +
+               stats.results[4] + stats.results[5];
+    }
+
+    // Opens one connection; players alternate between X and O (or all ask
+    // for any side) so that the server can always pair them.
+    void startBot(bool anySide) {
+        int type = anySide ? 0 : int(startedBots % 2) + 1;
+        startedBots++;
+
+        int fd = connectTo(address, port, true);
+        if (fd < 0) {
+            stats.connectErrors++;
+            return;
+        }
+
+        if (fd >= int(bots.size())) {
+            bots.resize(fd + 1);
+        }
+        bots[fd].reset(new Bot(fd, type));
+        openBots++;
+
+        struct epoll_event event = {};
+        event.events = EPOLLIN | EPOLLOUT;
+        event.data.fd = fd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+    }
+
+    void poll(int timeoutMs) {
+        // Channels in use are polled for a moment first, as the server does
+        bool channelsAsleep = false;
+        if (!channelBots.empty()) {
+            bool active = Clock::now() - channelActivity < std::chrono::milliseconds(CHANNEL_ACTIVE_MS);
+            if ((active && pollChannels()) || !(channelsAsleep = sleepChannels())) {
+                timeoutMs = 0;
+            }
+        }
+
+        struct epoll_event events[MAX_EVENTS];
+        int count = epoll_wait(epollFd, events, MAX_EVENTS, timeoutMs);
+        if (channelsAsleep) {
+            wakeChannels();
+        }
+        for (int i = 0; i < count; i++) {
+            if (events[i].data.u64 & DOORBELL) {
+                Bot* bot = botFor(int(uint32_t(events[i].data.u64)));
+                if (bot && bot->channel) {
+                    bot->channel->clearDoorbell();
+                    readChannel(bot);
+                }
+                continue;
+            }
+            int fd = events[i].data.fd;
+            Bot* bot = botFor(fd);
+            if (bot && (events[i].events & EPOLLOUT)) {
+                handleWritable(bot);
+            }
+            bot = botFor(fd);
+            if (bot && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+                handleReadable(bot);
+            }
+        }
+    }
+
+    // Drops connections that have waited longer than `limitMs` for the server.
+    void expire(int limitMs) {
+        auto cutoff = Clock::now() - std::chrono::milliseconds(limitMs);
+        for (auto& bot : bots) {
+            if (bot && bot->sentAt < cutoff) {
+                stats.timeouts++;
+                closeBot(bot.get());
+            }
+        }
+    }
+
+private:
+    Bot* botFor(int fd) {
+        return fd >= 0 && fd < int(bots.size()) ? bots[fd].get() : nullptr;
+    }
+
+    void handleWritable(Bot* bot) {
+        if (bot->state == Bot::CONNECTING) {
+            int error = 0;
+            socklen_t length = sizeof(error);
+            getsockopt(bot->fd, SOL_SOCKET, SO_ERROR, &error, &length);
+            if (error != 0) {
+                stats.connectErrors++;
+                closeBot(bot);
+                return;
+            }
+            bot->state = Bot::AWAIT_WELCOME;
+        }
+        flush(bot);
+    }
+
+    void handleReadable(Bot* bot) {
+        int fd = bot->fd;
+        if (bot->state == Bot::AWAIT_CHANNEL) {
+            openChannel(bot);
+            return;
+        }
+        // On a channel the socket only closes, possibly right after the
+        // result was written to the ring
+        if (bot->channel && (readChannel(bot) || botFor(fd) != bot)) {
+            return;
+        }
+
+        ssize_t received = bot->input.fill(fd);
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            return;
+        }
+        if (received <= 0) {
+            stats.disconnects++;
+            closeBot(bot);
+            return;
+        }
+
+        std::string_view message;
+        while (botFor(fd) == bot && bot->input.next(message)) {
+            handleMessage(bot, message);
+        }
+    }
+
+    void handleMessage(Bot* bot, std::string_view message) {
+        auto now = Clock::now();
+        int code = 0;
+        for (char c : message) {
+            if (c < '0' || c > '9') {
+                stats.protocolErrors++;
+                closeBot(bot);
+                return;
+            }
+            code = code * 10 + (c - '0');
+        }
+
+        if (bot->state == Bot::CONNECTING || bot->state == Bot::AWAIT_WELCOME) {
+            if (code != 700) {
+                stats.protocolErrors++;
+                closeBot(bot);
+                return;
+            }
+            stats.connect.record(microsBetween(bot->sentAt, now));
+            if (sharedMemory) {
+                send(bot, ShmChannel::REQUEST);
+                bot->state = Bot::AWAIT_CHANNEL;
+                return;
+            }
+            sendHello(bot);
+            return;
+        }
+
+        int statusCode = code / 100;
+        int moveCode = code % 100;
+        if (bot->state == Bot::AWAIT_START) {
+            stats.pairing.record(microsBetween(bot->sentAt, now));
+        } else {
+            stats.move.record(microsBetween(bot->sentAt, now));
+        }
+
+        if (statusCode >= 1 && statusCode <= 5) {
+            stats.results[statusCode]++;
+            closeBot(bot);
+            return;
+        }
+        if (statusCode != 0 && statusCode != 6) {
+            stats.protocolErrors++;
+            closeBot(bot);
+            return;
+        }
+
+        int row = moveCode / 10 - 1;
+        int col = moveCode % 10 - 1;
+        if (moveCode != 0 && row >= 0 && row < boardSize && col >= 0 && col < boardSize) {
+            bot->occupied |= uint64_t(1) << (row * boardSize + col);
+        }
+        bot->state = Bot::PLAYING;
+
+        // Random free cell
+        uint64_t free = ~bot->occupied & ((uint64_t(1) << (boardSize * boardSize)) - 1);
+        if (free == 0) {
+            stats.protocolErrors++;
+            closeBot(bot);
+            return;
+        }
+        int pick = rng() % __builtin_popcountll(free);
+        while (pick-- > 0) {
+            free &= free - 1;
+        }
+        int cell = __builtin_ctzll(free);
+        bot->occupied |= uint64_t(1) << cell;
+        send(bot, std::to_string((cell / boardSize + 1) * 10 + cell % boardSize + 1));
+    }
+
+    void sendHello(Bot* bot) {
+        send(bot, std::to_string(bot->playerType) + " load" + std::to_string(bot->fd));
+        bot->state = Bot::AWAIT_START;
+    }
+
+    void send(Bot* bot, const std::string& message) {
+        bot->sentAt = Clock::now();
+        if (!bot->channel) {
+            appendFrame(bot->output, message);
+            flush(bot);
+        } else if (!bot->channel->send(message)) {
+            stats.protocolErrors++;
+            closeBot(bot);
+        }
+    }
+
+    // Takes the server's grant and says hello through the new channel.
+    void openChannel(Bot* bot) {
+        std::unique_ptr<ShmChannel> channel = ShmChannel::receiveGrant(bot->fd);
+        if (!channel) {
+            if (errno == EAGAIN || errno == EINTR) return;
+            stats.protocolErrors++;
+            closeBot(bot);
+            return;
+        }
+        bot->channel = std::move(channel);
+        channelBots.push_back(bot->fd);
+        channelActivity = Clock::now();
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.u64 = uint64_t(bot->fd) | DOORBELL;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, bot->channel->doorbell(), &event);
+        sendHello(bot);
+    }
+
+    // Takes what the bot's channel holds; false if it was empty.
+    bool readChannel(Bot* bot) {
+        int fd = bot->fd;
+        std::string_view message;
+        bool received = false;
+        while (botFor(fd) == bot && bot->channel->receive(message)) {
+            received = true;
+            handleMessage(bot, message);
+        }
+        if (received) {
+            channelActivity = Clock::now();
+        }
+        if (botFor(fd) == bot && bot->channel->broken()) {
+            stats.protocolErrors++;
+            closeBot(bot);
+        }
+        return received;
+    }
+
+    bool pollChannels() {
+        auto deadline = Clock::now() + ShmChannel::spinTime();
+        do {
+            bool received = false;
+            for (size_t i = 0; i < channelBots.size(); i++) {
+                Bot* bot = botFor(channelBots[i]);
+                if (bot && readChannel(bot)) received = true;
+            }
+            if (received) return true;
+            cpuRelax();
+        } while (Clock::now() < deadline);
+        return false;
+    }
+
+    bool sleepChannels() {
+        bool asleep = true;
+        for (int fd : channelBots) {
+            if (!bots[fd]->channel->sleep()) asleep = false;
+        }
+        if (!asleep) wakeChannels();
+        return asleep;
+    }
+
+    void wakeChannels() {
+        for (int fd : channelBots) {
+            bots[fd]->channel->wake();
+        }
+    }
+
+    void flush(Bot* bot) {
+        while (!bot->output.empty()) {
+            ssize_t sent = ::send(bot->fd, bot->output.data(), bot->output.size(), MSG_NOSIGNAL);
+            if (sent < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                bot->output.clear();  // the read side reports the disconnect
+                break;
+            }
+            bot->output.erase(0, sent);
+        }
+
+        bool wantWrite = !bot->output.empty();
+        if (wantWrite != bot->wantWrite) {
+            struct epoll_event event = {};
+            event.events = wantWrite ? EPOLLIN | EPOLLOUT : EPOLLIN;
+            event.data.fd = bot->fd;
+            epoll_ctl(epollFd, EPOLL_CTL_MOD, bot->fd, &event);
+            bot->wantWrite = wantWrite;
+        }
+    }
+
+    void closeBot(Bot* bot) {
+        int fd = bot->fd;
+        if (bot->channel) {
+            epoll_ctl(epollFd, EPOLL_CTL_DEL, bot->channel->doorbell(), nullptr);
+            for (size_t i = 0; i < channelBots.size(); i++) {
+                if (channelBots[i] == fd) {
+                    channelBots[i] = channelBots.back();
+                    channelBots.pop_back();
+                    break;
+                }
+            }
+        }
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+        bots[fd].reset();
+        openBots--;
+    }
+};
+
+static void printHistogram(const std::string& name, const LatencyHistogram& histogram) {
+    std::cout << std::left << std::setw(10) << name << std::right << std::setw(10) << histogram.count()
+              << std::setw(10) << histogram.percentile(0.50) << std::setw(10) << histogram.percentile(0.90)
+              << std::setw(10) << histogram.percentile(0.99) << std::setw(10) << histogram.percentile(0.999)
+              << std::setw(10) << histogram.max() << "\n";
+}
+
+static void raiseFileLimit() {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    size_t connections = 1000;
+    double rate = 0;
+    uint64_t games = 0;
+    double duration = 10;
+    int timeoutMs = 10000;
+    bool anySide = false;
+    bool sharedMemory = false;
+    int variant = DEFAULT_VARIANT;
+
+    std::vector<std::string> args;
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "--connections" && hasValue) connections = std::stoul(argv[++i]);
+            else if (arg == "--rate" && hasValue) rate = std::stod(argv[++i]);
+            else if (arg == "--games" && hasValue) games = std::stoull(argv[++i]);
+            else if (arg == "--duration" && hasValue) duration = std::stod(argv[++i]);
+            else if (arg == "--timeout" && hasValue) timeoutMs = std::stoi(argv[++i]);
+            else if (arg == "--any-side") anySide = true;
+            else if (arg == "--shm") sharedMemory = true;
+            else if (arg == "--variant" && hasValue) variant = findVariant(argv[++i]);
+            else args.push_back(arg);
+        }
+    } catch (const std::exception& e) {
+        args.clear();
+    }
+    if (args.size() != 2 || connections < 2 || variant < 0) {
+        std::cerr << "Usage: " << argv[0] << " <IP|unix:PATH> <PORT> [options]\n"
+                  << "  --connections N  players connected at once (default 1000)\n"
+                  << "  --rate R         games started per second (default: as fast as possible)\n"
+                  << "  --games N        stop after N games (default: no limit)\n"
+                  << "  --duration S     stop after S seconds (default 10)\n"
+                  << "  --timeout MS     drop a player the server has not answered for MS (default 10000)\n"
+                  << "  --any-side       players ask for any side instead of alternating X and O\n"
+                  << "  --shm            players talk to the server through shared memory (unix: address)\n"
+                  << "  --variant NAME   board the server plays: " << VARIANT_NAMES << " (default "
+                  << VARIANTS[DEFAULT_VARIANT].name << ")\n";
+        return 1;
+    }
+
+    raiseFileLimit();
+    try {
+        LoadGenerator load(args[0], std::stoi(args[1]), VARIANTS[variant].size, sharedMemory);
+        auto start = Clock::now();
+        auto lastReport = start;
+        auto lastExpiry = start;
+        uint64_t reportedGames = 0;
+
+        while (true) {
+            auto now = Clock::now();
+            double elapsed = std::chrono::duration<double>(now - start).count();
+            if (elapsed >= duration || (games > 0 && load.gamesFinished() >= games)) {
+                break;
+            }
+
+            // Two players per game, within the connection budget and the rate
+            uint64_t allowed = rate > 0 ? uint64_t(2 * rate * elapsed) + 2 : UINT64_MAX;
+            if (games > 0) allowed = std::min(allowed, 2 * games);
+            while (load.open() + 1 < connections && load.started() + 2 <= allowed) {
+                load.startBot(anySide);
+                load.startBot(anySide);
+            }
+
+            load.poll(10);
+
+            if (now - lastExpiry >= std::chrono::seconds(1)) {
+                load.expire(timeoutMs);
+                lastExpiry = now;
+            }
+            if (now - lastReport >= std::chrono::seconds(1)) {
+                uint64_t finished = load.gamesFinished();
+                double interval = std::chrono::duration<double>(now - lastReport).count();
+                std::cerr << std::fixed << std::setprecision(1) << elapsed << "s: "
+                          << (finished - reportedGames) / interval << " games/sec, " << load.open()
+                          << " open, " << load.errors() << " errors" << std::endl;
+                reportedGames = finished;
+                lastReport = now;
+            }
+        }
+
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        const LoadStats& stats = load.results();
+        uint64_t finished = load.gamesFinished();
+
+        std::cout << "\nGames: " << finished << " in " << std::fixed << std::setprecision(1) << seconds
+                  << " s (" << finished / seconds << " games/sec)\n\n"
+                  << std::left << std::setw(10) << "latency" << std::right << std::setw(10) << "count"
+                  << std::setw(10) << "p50 us" << std::setw(10) << "p90 us" << std::setw(10) << "p99 us"
+                  << std::setw(10) << "p999 us" << std::setw(10) << "max us" << "\n";
+        printHistogram("connect", stats.connect);
+        printHistogram("pairing", stats.pairing);
+        printHistogram("move", stats.move);
+
+        std::cout << "\nResults: " << stats.results[1] << " won, " << stats.results[2] << " lost, "
+                  << stats.results[3] << " draw, " << stats.results[4] << " won by error, "
+                  << stats.results[5] << " lost by error\n"
+                  << "Errors: " << stats.connectErrors << " connect, " << stats.disconnects << " disconnect, "
+                  << stats.protocolErrors << " protocol, " << stats.timeouts << " timeout" << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,241 @@
+#pragma once
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Binary game logs. A log file is a 16-byte header followed by fixed-size
+// 104-byte records, one per finished game, so a file can be mapped and read
+// as an array. Moves are cells (row * size + col) in the order played; a
+// record has room for every move on the largest board, 7x7. Version 1 logs,
+// from before variants, had 80-byte records with 25 moves.
+
+enum GameLogResult : uint8_t {
+    LOG_DRAW = 0,
+    LOG_X_WINS = 1,
+    LOG_O_WINS = 2
+};
+
+// How the game ended.
+enum GameLogReason : uint8_t {
+    LOG_FOUR_IN_A_ROW = 0,
+    LOG_FORBIDDEN_THREE = 1,
+    LOG_FULL_BOARD = 2,
+    LOG_ILLEGAL_MOVE = 3,
+    LOG_DISCONNECT = 4,
+    LOG_TIME_FORFEIT = 5
+};
+
+struct GameLogHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t recordSize;
+    uint64_t reserved;
+};
+
+struct GameRecord {
+    static constexpr int NAME_LENGTH = 16;
+    static constexpr int MAX_MOVES = 49;
+
+    uint64_t startMicros;             // wall clock, microseconds since the epoch
+    uint32_t durationMs;
+    uint8_t moveCount;
+    uint8_t result;                   // GameLogResult
+    uint8_t reason;                   // GameLogReason
+    uint8_t boardSize;                // 0 in logs from before variants: 5
+    char names[2][NAME_LENGTH];       // X then O, NUL-padded, truncated if longer
+    uint8_t moves[MAX_MOVES];
+    uint8_t reserved1[7];
+
+    void setName(int player, const std::string& name) {
+        std::memset(names[player], 0, NAME_LENGTH);
+        std::memcpy(names[player], name.data(), std::min<size_t>(name.size(), NAME_LENGTH));
+    }
+
+    std::string name(int player) const {
+        return std::string(names[player], strnlen(names[player], NAME_LENGTH));
+    }
+};
+
+static_assert(sizeof(GameLogHeader) == 16, "log header layout");
+static_assert(sizeof(GameRecord) == 104, "log record layout");
+
+constexpr uint32_t GAME_LOG_MAGIC = 0x4c473554;  // "T5GL"
+constexpr uint16_t GAME_LOG_VERSION = 2;
+
+// Appends records to `<base>.<n>` files, starting a new file once the
+// current one would exceed `maxBytes`. Records are collected in memory and
+// written in batches with one write() each; call flush() to bound how long a
+// record can stay in memory. Not thread safe: one writer per event loop.
+class GameLogWriter {
+private:
+    static constexpr size_t BATCH_RECORDS = 256;
+
+    std::string base;
+    size_t maxBytes;
+    int fd;
+    int fileIndex;
+    size_t fileBytes;
+    std::vector<GameRecord> pending;
+    std::chrono::steady_clock::time_point lastFlush;
+
+    void openNext() {
+        if (fd >= 0) {
+            close(fd);
+        }
+        // Never append to a file from an earlier run
+        std::string path;
+        struct stat info;
+        do {
+            path = base + "." + std::to_string(++fileIndex);
+        } while (stat(path.c_str(), &info) == 0);
+
+        fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot create game log " + path + ": " + std::strerror(errno));
+        }
+        GameLogHeader header = {GAME_LOG_MAGIC, GAME_LOG_VERSION, sizeof(GameRecord), 0};
+        writeAll(&header, sizeof(header));
+        fileBytes = sizeof(header);
+    }
+
+    void writeAll(const void* data, size_t size) {
+        const char* bytes = static_cast<const char*>(data);
+        while (size > 0) {
+            ssize_t written = write(fd, bytes, size);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                throw std::runtime_error(std::string("Game log write failed: ") + std::strerror(errno));
+            }
+            bytes += written;
+            size -= size_t(written);
+        }
+    }
+
+public:
+    GameLogWriter(const std::string& basePath, size_t maxFileBytes)
+        : base(basePath), maxBytes(std::max(maxFileBytes, sizeof(GameLogHeader) + sizeof(GameRecord))),
+          fd(-1), fileIndex(0), fileBytes(0), lastFlush(std::chrono::steady_clock::now()) {
+        pending.reserve(BATCH_RECORDS);
+        openNext();
+    }
+
+    ~GameLogWriter() {
+        try {
+            flush();
+        } catch (const std::exception&) {
+        }
+        close(fd);
+    }
+
+    bool hasPending() const {
+        return !pending.empty();
+    }
+
+    // Time since records were last written out.
+    std::chrono::steady_clock::duration sinceFlush() const {
+        return std::chrono::steady_clock::now() - lastFlush;
+    }
+
+    void append(const GameRecord& record) {
+        pending.push_back(record);
+        if (pending.size() >= BATCH_RECORDS) {
+            flush();
+        }
+    }
+
+    void flush() {
+        lastFlush = std::chrono::steady_clock::now();
+        size_t done = 0;
+        while (done < pending.size()) {
+            size_t room = (maxBytes - fileBytes) / sizeof(GameRecord);
+            if (room == 0) {
+                openNext();
+                continue;
+            }
+            size_t count = std::min(room, pending.size() - done);
+            writeAll(&pending[done], count * sizeof(GameRecord));
+            fileBytes += count * sizeof(GameRecord);
+            done += count;
+        }
+        pending.clear();
+    }
+};
+
+// Read-only view of one log file, mapped into memory. Records are read in
+// place: iterating is a walk over an array.
+class GameLogReader {
+private:
+    const char* data;
+    size_t length;
+    const GameRecord* first;
+    size_t count;
+
+public:
+    explicit GameLogReader(const std::string& path) : data(nullptr), length(0), first(nullptr), count(0) {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot open game log " + path + ": " + std::strerror(errno));
+        }
+        struct stat info;
+        if (fstat(fd, &info) < 0 || size_t(info.st_size) < sizeof(GameLogHeader)) {
+            close(fd);
+            throw std::runtime_error("Not a game log: " + path);
+        }
+        length = size_t(info.st_size);
+        void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED) {
+            throw std::runtime_error("Cannot map game log " + path + ": " + std::strerror(errno));
+        }
+        data = static_cast<const char*>(mapped);
+        madvise(mapped, length, MADV_SEQUENTIAL);
+
+        const GameLogHeader* header = reinterpret_cast<const GameLogHeader*>(data);
+        if (header->magic != GAME_LOG_MAGIC) {
+            munmap(const_cast<char*>(data), length);
+            throw std::runtime_error("Not a game log: " + path);
+        }
+        if (header->version != GAME_LOG_VERSION || header->recordSize != sizeof(GameRecord)) {
+            uint16_t version = header->version;
+            munmap(const_cast<char*>(data), length);
+            throw std::runtime_error("Game log " + path + " has version " + std::to_string(version) +
+                                     ", this build reads version " + std::to_string(GAME_LOG_VERSION));
+        }
+        first = reinterpret_cast<const GameRecord*>(data + sizeof(GameLogHeader));
+        count = (length - sizeof(GameLogHeader)) / sizeof(GameRecord);  // ignores a torn last record
+    }
+
+    ~GameLogReader() {
+        if (data) {
+            munmap(const_cast<char*>(data), length);
+        }
+    }
+
+    GameLogReader(const GameLogReader&) = delete;
+    GameLogReader& operator=(const GameLogReader&) = delete;
+
+    size_t size() const {
+        return count;
+    }
+
+    const GameRecord& operator[](size_t index) const {
+        return first[index];
+    }
+
+    const GameRecord* begin() const {
+        return first;
+    }
+
+    const GameRecord* end() const {
+        return first + count;
+    }
+};
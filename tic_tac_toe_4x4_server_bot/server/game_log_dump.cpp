@@ -0,0 +1,81 @@
+#include <chrono>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "game_log.hpp"
+
+// Reads binary game logs written by game_server --game-log and prints a
+// summary, or one line per game with --list.
+
+static const char* RESULT_NAMES[] = {"draw", "X wins", "O wins"};
+static const char* REASON_NAMES[] = {"four in a row", "forbidden three", "full board", "illegal move", "disconnect",
+                                      "time forfeit"};
+
+static void printGame(const GameRecord& record) {
+    std::time_t seconds = std::time_t(record.startMicros / 1000000);
+    char when[32];
+    std::strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", std::localtime(&seconds));
+
+    std::cout << when << "  " << record.name(0) << " vs " << record.name(1) << "  "
+              << (record.result <= LOG_O_WINS ? RESULT_NAMES[record.result] : "?") << " ("
+              << (record.reason <= LOG_TIME_FORFEIT ? REASON_NAMES[record.reason] : "?") << ", "
+              << record.durationMs << " ms) ";
+    int size = record.boardSize ? record.boardSize : 5;
+    for (int i = 0; i < record.moveCount && i < GameRecord::MAX_MOVES; i++) {
+        std::cout << " " << record.moves[i] / size + 1 << record.moves[i] % size + 1;
+    }
+    std::cout << "\n";
+}
+
+int main(int argc, char* argv[]) {
+    bool list = false;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--list") {
+            list = true;
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    if (paths.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [--list] LOG_FILE..." << std::endl;
+        return 1;
+    }
+
+    uint64_t games = 0;
+    uint64_t moves = 0;
+    uint64_t results[3] = {};
+    uint64_t reasons[6] = {};
+    auto start = std::chrono::steady_clock::now();
+
+    try {
+        for (const auto& path : paths) {
+            GameLogReader log(path);
+            for (const GameRecord& record : log) {
+                games++;
+                moves += record.moveCount;
+                if (record.result <= LOG_O_WINS) results[record.result]++;
+                if (record.reason <= LOG_TIME_FORFEIT) reasons[record.reason]++;
+                if (list) printGame(record);
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Games: " << games << " in " << paths.size() << " file(s), read at "
+              << std::fixed << std::setprecision(0) << games / std::max(seconds, 1e-9) << " games/sec\n"
+              << "Results: " << results[LOG_X_WINS] << " X wins, " << results[LOG_O_WINS] << " O wins, "
+              << results[LOG_DRAW] << " draws\n"
+              << "Average length: " << std::setprecision(1) << (games > 0 ? double(moves) / games : 0.0)
+              << " moves\n";
+    for (int reason = 0; reason <= LOG_TIME_FORFEIT; reason++) {
+        std::cout << "  " << REASON_NAMES[reason] << ": " << reasons[reason] << "\n";
+    }
+    return 0;
+}
@@ -3,47 +3,31 @@
 #include <cstring>
 #include <unistd.h>
 #include <random>
-#include <arpa/inet.h>
+#include <vector>
 #include "board.hpp"
+#include "transport.hpp"
 
 class RandomBot {
 private:
-    int socket;
+    ServerConnection server;
     GameBoard board;
     int playerType;
     std::mt19937 rng;
 
 public:
-    RandomBot(const std::string& ip, int port, int playerType, const std::string& name)
-        : playerType(playerType), rng(std::random_device()()) {
-        connectToServer(ip, port);
-        authenticate(playerType, name);
+    RandomBot(const std::string& address, int port, int playerType, const std::string& name, bool sharedMemory,
+              int variant)
+        : server(address, port), board(variant), playerType(playerType), rng(std::random_device()()) {
+        authenticate(playerType, name, sharedMemory);
         playGame();
     }
 
-    ~RandomBot() {
-        close(socket);
-    }
-
 private:
-    void connectToServer(const std::string& ip, int port) {
-        socket = ::socket(AF_INET, SOCK_STREAM, 0);
-        if (socket < 0) {
-            throw std::runtime_error("Failed to create socket");
-        }
-
-        struct sockaddr_in serverAddr;
-        serverAddr.sin_family = AF_INET;
-        serverAddr.sin_port = htons(port);
-        serverAddr.sin_addr.s_addr = inet_addr(ip.c_str());
-
-        if (connect(socket, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) < 0) {
-            throw std::runtime_error("Connection failed");
-        }
-    }
-
-    void authenticate(int playerType, const std::string& name) {
+    void authenticate(int playerType, const std::string& name, bool sharedMemory) {
         receiveMessage(); // Ignore the welcome message
+        if (sharedMemory) {
+            server.useSharedMemory();
+        }
 
         std::string authMsg = std::to_string(playerType) + " " + name;
         sendMessage(authMsg);
@@ -52,6 +36,7 @@ private:
     void playGame() {
         board.reset();
         bool gameEnded = false;
+        bool sideKnown = false;
 
         while (!gameEnded) {
             std::string serverMsg = receiveMessage();
@@ -60,6 +45,13 @@ private:
             int moveCode = code % 100;
             int statusCode = code / 100;
 
+            // The lobby may seat us on either side, whatever we asked for:
+            // 600 means X, an opponent move first means O
+            if (!sideKnown && (statusCode == 0 || statusCode == 6)) {
+                sideKnown = true;
+                playerType = statusCode == 6 ? 1 : 2;
+            }
+
             if (moveCode != 0) {
                 board.placeMove(moveCode, 3 - playerType);
             }
@@ -81,8 +73,8 @@ private:
     int generateRandomMove() {
         std::vector<int> validMoves;
 
-        for (int row = 0; row < 5; row++) {
-            for (int col = 0; col < 5; col++) {
+        for (int row = 0; row < board.size(); row++) {
+            for (int col = 0; col < board.size(); col++) {
                 if (board.getCellValue(row, col) == 0) {
                     validMoves.push_back((row + 1) * 10 + (col + 1));
                 }
@@ -108,32 +100,48 @@ private:
     }
 
     void sendMessage(const std::string& message) {
-        if (send(socket, message.c_str(), message.length(), 0) < 0) {
+        if (!server.send(message)) {
             throw std::runtime_error("Failed to send message");
         }
     }
 
     std::string receiveMessage() {
-        char buffer[16] = {0};
-        if (recv(socket, buffer, sizeof(buffer), 0) < 0) {
+        std::string_view message;
+        if (!server.receive(message)) {
             throw std::runtime_error("Failed to receive message");
         }
-        return std::string(buffer);
+        return std::string(message);
     }
 };
 
 int main(int argc, char *argv[]) {
-    if (argc != 5) {
-        std::cerr << "Usage: " << argv[0] << " <IP> <PORT> <PLAYER_TYPE> <NAME>\n";
+    bool sharedMemory = false;
+    int variant = DEFAULT_VARIANT;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--shm") {
+            sharedMemory = true;
+        } else if (arg == "--variant" && i + 1 < argc) {
+            variant = findVariant(argv[++i]);
+        } else {
+            args.push_back(arg);
+        }
+    }
+    if (args.size() != 4 || variant < 0) {
+        std::cerr << "Usage: " << argv[0] << " <IP|unix:PATH> <PORT> <PLAYER_TYPE> <NAME> [--shm] [--variant NAME]\n";
+        std::cerr << "  variants: " << VARIANT_NAMES << "\n";
         return 1;
     }
 
     try {
         RandomBot bot(
-            argv[1],
-            std::stoi(argv[2]),
-            std::stoi(argv[3]),
-            argv[4]
+            args[0],
+            std::stoi(args[1]),
+            std::stoi(args[2]),
+            args[3],
+            sharedMemory,
+            variant
         );
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << "\n";
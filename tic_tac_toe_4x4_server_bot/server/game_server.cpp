@@ -1,280 +1,1336 @@
+#include <atomic>
+#include <charconv>
+#include <csignal>
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <cstring>
+#include <cerrno>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
 #include <unistd.h>
-#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
 #include "board.hpp"
+#include "game_log.hpp"
+#include "handover.hpp"
+#include "lobby.hpp"
+#include "logger.hpp"
+#include "metrics.hpp"
+#include "protocol.hpp"
+#include "ratings.hpp"
+#include "result_store.hpp"
+#include "shm_channel.hpp"
+#include "spectators.hpp"
+#include "timer_wheel.hpp"
+#include "transport.hpp"
 
-class GameServer {
-private:
-    int serverSocket;
-    int playerSockets[2];
+static_assert(GameRecord::MAX_MOVES >= BoardPatterns::MAX_CELLS, "a log record holds every move on every variant");
+
+struct Game;
+
+// One client connection. Reads and writes never block: incoming bytes are
+// framed in a per-connection ring, outgoing messages are buffered and
+// flushed when the socket becomes writable again. A client on the same host
+// may move its messages to a shared-memory channel instead.
+struct Session {
+    enum State { AWAIT_HELLO, WAITING, PLAYING, CLOSING };
+
+    int fd;
+    State state;
+    int playerType;                                  // requested side: 1 = X, 2 = O, 0 = any
+    std::string playerName;
+    FrameReader input;
+    std::string output;
+    bool wantWrite;
+    std::shared_ptr<ShmChannel> channel;             // messages go here instead of the socket
+    Game* game;
+    double rating;
+    std::chrono::steady_clock::time_point waitingSince;
+
+    explicit Session(int socket)
+        : fd(socket), state(AWAIT_HELLO), playerType(0), wantWrite(false), game(nullptr), rating(0) {}
+};
+
+// One game between two sessions: player 1 (X) moves first, then turns
+// alternate until a win, a forbidden three, a full board or an error.
+struct Game {
+    uint64_t id;
+    Session* players[2];
     std::string playerNames[2];
     GameBoard board;
-    bool playerConnected[2];
     int currentPlayer;
     int moveCounter;
+    GameRecord record;                               // written to the game log when it ends
+    std::chrono::steady_clock::time_point startTime;
+    std::chrono::steady_clock::time_point promptTime;  // when the player to move was told so
+    std::chrono::steady_clock::duration remaining[2];  // clock time left, with an initial/increment clock
+    TimerWheel<Game>::Node clockTimer;                 // fires when the player to move runs out of time
+};
+
+// A player that is waiting for an opponent and has been released by its
+// worker so that any worker can adopt the connection.
+struct HandoffPlayer {
+    int fd;
+    std::string playerName;
+    std::shared_ptr<ShmChannel> channel;
+};
+
+// Players that could not be paired on the worker that accepted them, in a
+// lobby with the same pairing policy as the workers' own. Workers only look
+// here when they have no local opponent, so the lock stays off the path of
+// games that pair locally.
+class PlayerExchange {
+private:
+    std::mutex mutex;
+    Lobby<HandoffPlayer> lobby;
 
 public:
-    GameServer(const std::string& ip, int port) : moveCounter(0) {
-        playerSockets[0] = -1;
-        playerSockets[1] = -1;
-        playerConnected[0] = false;
-        playerConnected[1] = false;
+    explicit PlayerExchange(PairingPolicy pairing) : lobby(pairing) {}
 
-        // Create socket
-        serverSocket = socket(AF_INET, SOCK_STREAM, 0);
-        if (serverSocket < 0) {
-            throw std::runtime_error("Failed to create socket");
-        }
+    void publish(const HandoffPlayer& player, int side, double rating) {
+        std::lock_guard<std::mutex> lock(mutex);
+        lobby.add(player, side, rating);
+    }
 
-        // Set socket options
-        int opt = 1;
-        if (setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
-            throw std::runtime_error("Failed to set socket options");
+    bool takeOpponent(int side, double rating, Lobby<HandoffPlayer>::Entry& opponent) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return lobby.takeOpponent(side, rating, opponent);
+    }
+
+    std::vector<Lobby<HandoffPlayer>::Entry> takeAll() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return lobby.takeAll();
+    }
+};
+
+// How the server stops. The mode is set once, by a signal (SHUTDOWN) or by
+// a new process taking over (HANDOVER); from then on drainEvent stays
+// readable and every worker stops accepting, finishes its games and exits.
+enum DrainMode { RUNNING, SHUTDOWN, HANDOVER };
+
+static std::atomic<int> drainMode(RUNNING);
+static int drainEvent = -1;
+static int successorSocket = -1;                     // control connection of the new process, with HANDOVER
+
+static bool requestDrain(int mode) {
+    int expected = RUNNING;
+    if (!drainMode.compare_exchange_strong(expected, mode)) {
+        return false;
+    }
+    uint64_t one = 1;
+    ssize_t ignored = write(drainEvent, &one, sizeof(one));
+    (void)ignored;
+    return true;
+}
+
+static void onStopSignal(int signalNumber) {
+    std::signal(signalNumber, SIG_DFL);  // a second signal stops at once
+    requestDrain(SHUTDOWN);
+}
+
+// Clock for each game. With `initial` set, each player has that much time
+// for the whole game plus `increment` per move made (like a chess clock);
+// with `perMove` set, every move must arrive within that time instead.
+// Running out of time loses the game with 500.
+struct TimeControl {
+    std::chrono::milliseconds initial{0};
+    std::chrono::milliseconds increment{0};
+    std::chrono::milliseconds perMove{0};
+
+    bool enabled() const {
+        return initial.count() > 0 || perMove.count() > 0;
+    }
+};
+
+// Parses "SECONDS" or "SECONDS+INCREMENT", e.g. "60+0.5".
+static bool parseClock(const std::string& text, TimeControl& control) {
+    size_t plus = text.find('+');
+    try {
+        size_t used = 0;
+        double initial = std::stod(text.substr(0, plus), &used);
+        if (used != (plus == std::string::npos ? text.size() : plus)) return false;
+        double increment = 0;
+        if (plus != std::string::npos) {
+            increment = std::stod(text.substr(plus + 1), &used);
+            if (used != text.size() - plus - 1) return false;
         }
+        if (initial <= 0 || increment < 0) return false;
+        control.initial = std::chrono::milliseconds(int64_t(initial * 1000));
+        control.increment = std::chrono::milliseconds(int64_t(increment * 1000));
+        return control.initial.count() > 0;
+    } catch (const std::exception&) {
+        return false;
+    }
+}
 
-        // Bind socket
-        struct sockaddr_in address;
-        address.sin_family = AF_INET;
-        address.sin_addr.s_addr = inet_addr(ip.c_str());
-        address.sin_port = htons(port);
+// State shared by all workers of one server.
+struct ServerShared {
+    int workers;
+    int sharedListener = -1;                         // on a Unix socket the workers share one listener
+    PairingPolicy pairing;
+    PlayerExchange exchange;
+    RatingTable ratings;
+    std::unique_ptr<ResultStore> results;            // null: ratings last as long as the process
+    SpectatorHub spectators;
+    TimeControl timeControl;                         // disabled: no clocks
+    int variant = DEFAULT_VARIANT;                   // index into VARIANTS; every game is played on it
+    std::string gameLogBase;                         // empty: no game log
+    size_t gameLogBytes = 64 << 20;
 
-        if (bind(serverSocket, (struct sockaddr*)&address, sizeof(address)) < 0) {
-            throw std::runtime_error("Socket binding failed");
+    ServerShared(int workerCount, PairingPolicy policy, size_t spectatorBufferBytes)
+        : workers(workerCount), pairing(policy), exchange(policy), spectators(spectatorBufferBytes) {}
+};
+
+class GameServer {
+private:
+    static const int MAX_EVENTS = 256;
+    static const int HANDOFF_DELAY_MS = 50;  // local wait before a player is offered to other workers
+    static const int LOG_FLUSH_MS = 1000;    // longest time a finished game stays unwritten
+    static const int CLOCK_TICK_MS = 10;     // resolution of game clocks
+    static const int CLOCK_SLOTS = 1024;     // timer wheel revolution: about 10 seconds
+    static const int DRAIN_HELLO_MS = 5000;  // while draining, how long a connection may take to say hello
+    static const int CHANNEL_ACTIVE_MS = 5;  // channels are polled before sleeping while this recently used
+    static constexpr uint64_t DOORBELL = uint64_t(1) << 32;  // epoll data of a doorbell: session fd | DOORBELL
+
+    // A connection taken over from another thread, with its hello if it
+    // has sent one.
+    struct Adoption {
+        int fd;
+        std::string hello;
+        std::shared_ptr<ShmChannel> channel;
+    };
+
+    int serverSocket;
+    bool localListener;                              // a Unix socket: clients may ask for shared memory
+    int epollFd;
+    int inboxEvent;                                  // readable when connections were adopted from outside
+    std::mutex inboxMutex;
+    std::vector<Adoption> inbox;
+    bool draining;
+    bool helloGraceOver;                             // connections still without a hello were let go
+    std::chrono::steady_clock::time_point drainStarted;
+    std::vector<std::unique_ptr<Session>> sessions;  // indexed by fd
+    std::vector<int> channelSessions;                // fds of sessions on shared memory
+    std::chrono::steady_clock::time_point channelActivity;  // last message through a channel
+    std::unordered_map<uint64_t, std::unique_ptr<Game>> games;
+    Lobby<Session*> lobby;                           // players waiting for an opponent
+    uint64_t nextGameId;
+    int workerIndex;
+    int workerCount;
+    RatingTable& ratings;
+    ResultStore* results;
+    SpectatorHub& spectators;
+    PlayerExchange* exchange;                        // shared by all workers, null with one worker
+    std::unique_ptr<GameLogWriter> gameLog;          // this worker's log files, if enabled
+    WorkerMetrics metrics;
+    TimeControl timeControl;
+    int variant;
+    TimerWheel<Game> clocks;                         // one timer per game with a clock
+
+public:
+    // With several workers each one owns a listener bound to the same port
+    // (SO_REUSEPORT), its own epoll loop and its own games; the kernel spreads
+    // new connections across the listeners. A Unix socket path cannot be
+    // bound twice, so there the workers share one listener and are woken for
+    // it one at a time.
+    //
+    // `listenFd`, if not -1, is a listener taken over from an earlier process.
+    GameServer(const std::string& ip, int port, int index, ServerShared& shared, int listenFd = -1)
+        : draining(false), helloGraceOver(false), lobby(shared.pairing), nextGameId(index + 1),
+          workerIndex(index), workerCount(shared.workers),
+          ratings(shared.ratings), results(shared.results.get()), spectators(shared.spectators),
+          exchange(shared.workers > 1 ? &shared.exchange : nullptr), timeControl(shared.timeControl),
+          variant(shared.variant), clocks(std::chrono::milliseconds(CLOCK_TICK_MS), CLOCK_SLOTS) {
+        if (!shared.gameLogBase.empty()) {
+            gameLog.reset(new GameLogWriter(shared.gameLogBase + "." + std::to_string(index), shared.gameLogBytes));
         }
 
-        // Listen for connections
-        if (listen(serverSocket, 3) < 0) {
-            throw std::runtime_error("Socket listen failed");
+        serverSocket = listenFd;
+        if (serverSocket < 0 && shared.sharedListener >= 0) {
+            serverSocket = dup(shared.sharedListener);
+        } else if (serverSocket < 0) {
+            serverSocket = listenOn(ip, port, workerCount > 1);
         }
+        struct sockaddr_storage bound = {};
+        socklen_t boundLength = sizeof(bound);
+        getsockname(serverSocket, (struct sockaddr*)&bound, &boundLength);
+        localListener = bound.ss_family == AF_UNIX;
 
-        std::cout << "Server started on " << ip << ":" << port << std::endl;
+        // Create the event loop
+        epollFd = epoll_create1(0);
+        inboxEvent = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epollFd < 0 || inboxEvent < 0) {
+            throw std::runtime_error("Failed to create epoll instance");
+        }
+        for (int fd : {serverSocket, drainEvent, inboxEvent}) {
+            struct epoll_event event = {};
+            event.events = fd == serverSocket ? EPOLLIN | EPOLLEXCLUSIVE : EPOLLIN;
+            event.data.fd = fd;
+            if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+                throw std::runtime_error("Failed to watch listening socket");
+            }
+        }
+
+        if (workerIndex == 0) {
+            LOG(INFO) << (listenFd < 0 ? "Server started on " : "Server took over ") << describeAddress(ip, port) << " playing "
+                      << VARIANTS[variant].name;
+        }
     }
 
     ~GameServer() {
-        close(serverSocket);
-        if (playerSockets[0] >= 0) close(playerSockets[0]);
-        if (playerSockets[1] >= 0) close(playerSockets[1]);
+        for (auto& session : sessions) {
+            if (session) close(session->fd);
+        }
+        close(epollFd);
+        close(inboxEvent);
+        if (serverSocket >= 0) close(serverSocket);
+    }
+
+    WorkerMetrics& workerMetrics() {
+        return metrics;
     }
 
+    int listenSocket() const {
+        return serverSocket;
+    }
+
+    // Takes over a connection from another thread: a waiting player with its
+    // hello, or a connection that has not sent one yet (empty hello).
+    void adopt(int fd, std::string hello, std::shared_ptr<ShmChannel> channel = nullptr) {
+        {
+            std::lock_guard<std::mutex> lock(inboxMutex);
+            inbox.push_back(Adoption{fd, std::move(hello), std::move(channel)});
+        }
+        uint64_t one = 1;
+        ssize_t ignored = write(inboxEvent, &one, sizeof(one));
+        (void)ignored;
+    }
+
+    // Serves until draining has finished.
     void run() {
+        struct epoll_event events[MAX_EVENTS];
         while (true) {
-            acceptConnections();
-            playGame();
-            resetGame();
+            int timeout = exchange && !lobby.empty() && !draining ? HANDOFF_DELAY_MS : -1;
+            if (gameLog && gameLog->hasPending() && (timeout < 0 || timeout > LOG_FLUSH_MS)) {
+                timeout = LOG_FLUSH_MS;
+            }
+            if (!clocks.empty() && (timeout < 0 || timeout > CLOCK_TICK_MS)) {
+                timeout = CLOCK_TICK_MS;
+            }
+            if (draining && (timeout < 0 || timeout > LOG_FLUSH_MS)) {
+                timeout = LOG_FLUSH_MS;
+            }
+
+            // Channels in use are polled for a moment before the loop
+            // sleeps, so that a quick reply costs neither side a wakeup
+            bool channelsAsleep = false;
+            if (!channelSessions.empty()) {
+                bool active = std::chrono::steady_clock::now() - channelActivity <
+                              std::chrono::milliseconds(CHANNEL_ACTIVE_MS);
+                if ((active && pollChannels()) || !(channelsAsleep = sleepChannels())) {
+                    timeout = 0;
+                }
+            }
+            int count = epoll_wait(epollFd, events, MAX_EVENTS, timeout);
+            if (channelsAsleep) {
+                wakeChannels();
+            }
+            if (count < 0) {
+                if (errno == EINTR) continue;
+                throw std::runtime_error("epoll_wait failed");
+            }
+
+            for (int i = 0; i < count; i++) {
+                if (events[i].data.u64 & DOORBELL) {
+                    Session* session = sessionFor(int(uint32_t(events[i].data.u64)));
+                    if (session && session->channel) {
+                        session->channel->clearDoorbell();
+                        readChannel(session);
+                    }
+                    continue;
+                }
+                int fd = events[i].data.fd;
+                if (fd == serverSocket) {
+                    acceptConnections();
+                    continue;
+                }
+                if (fd == drainEvent) {
+                    beginDrain();
+                    continue;
+                }
+                if (fd == inboxEvent) {
+                    takeInbox();
+                    continue;
+                }
+
+                Session* session = sessionFor(fd);
+                if (!session) continue;
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                    handleReadable(session);
+                }
+                session = sessionFor(fd);
+                if (session && (events[i].events & EPOLLOUT)) {
+                    flush(session);
+                }
+            }
+
+            if (!clocks.empty()) {
+                clocks.advance(std::chrono::steady_clock::now(), [this](Game* game) { flagFall(game); });
+            }
+            if (exchange && !draining) {
+                handOffWaitingPlayers();
+            }
+            if (gameLog && gameLog->hasPending() &&
+                gameLog->sinceFlush() >= std::chrono::milliseconds(LOG_FLUSH_MS)) {
+                gameLog->flush();
+            }
+            if (draining) {
+                if (!helloGraceOver &&
+                    std::chrono::steady_clock::now() - drainStarted >= std::chrono::milliseconds(DRAIN_HELLO_MS)) {
+                    helloGraceOver = true;
+                    releaseAll(Session::AWAIT_HELLO);
+                }
+                if (games.empty() && metrics.connectionsOpen.load(std::memory_order_relaxed) == 0) {
+                    LOG(INFO) << "Worker " << workerIndex << " drained";
+                    return;
+                }
+            }
         }
     }
 
 private:
-    void acceptConnections() {
-        std::cout << "Waiting for players to connect..." << std::endl;
+    // Stops accepting and lets go of every connection that has no game yet;
+    // games in progress are played to the end.
+    void beginDrain() {
+        draining = true;
+        drainStarted = std::chrono::steady_clock::now();
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, drainEvent, nullptr);
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, serverSocket, nullptr);
+        close(serverSocket);  // with HANDOVER the new process holds its own copy
+        serverSocket = -1;
+        LOG(INFO) << "Worker " << workerIndex << " draining: " << games.size() << " games in progress";
 
-        while (!playerConnected[0] || !playerConnected[1]) {
-            struct sockaddr_in clientAddr;
-            socklen_t addrLen = sizeof(clientAddr);
-            int clientSocket = accept(serverSocket, (struct sockaddr*)&clientAddr, &addrLen);
+        lobby.takeAll();
+        releaseAll(Session::WAITING);
+        releaseAll(Session::AWAIT_HELLO);
+    }
+
+    // Releases sessions in `state`; those still reading a hello are kept
+    // until it is complete.
+    void releaseAll(Session::State state) {
+        for (auto& slot : sessions) {
+            Session* session = slot.get();
+            if (session && session->state == state &&
+                (state != Session::AWAIT_HELLO || session->input.size() == 0 || helloGraceOver)) {
+                release(session);
+            }
+        }
+    }
+
+    // Passes a connection without a game to the new process, or closes it
+    // when shutting down.
+    void release(Session* session) {
+        if (drainMode.load() == HANDOVER) {
+            std::string message = "CONNECTED";
+            if (session->state == Session::WAITING) {
+                message = "PLAYER " + std::to_string(session->playerType) + " " + session->playerName;
+            }
+            std::vector<int> fds = {session->fd};
+            if (session->channel) {
+                for (int fd : session->channel->descriptors()) fds.push_back(fd);
+            }
+            if (!sendHandover(successorSocket, message, fds)) {
+                LOG(WARN) << "Could not hand over a connection: " << std::strerror(errno);
+            }
+        }
+        closeSession(session);
+    }
+
+    void takeInbox() {
+        uint64_t value;
+        ssize_t ignored = read(inboxEvent, &value, sizeof(value));
+        (void)ignored;
+        std::vector<Adoption> adopted;
+        {
+            std::lock_guard<std::mutex> lock(inboxMutex);
+            adopted.swap(inbox);
+        }
+        for (Adoption& connection : adopted) {
+            Session* session = addSession(connection.fd);
+            WorkerMetrics::add(metrics.connectionsAccepted);
+            if (connection.channel) {
+                attachChannel(session, std::move(connection.channel));
+            }
+            if (!connection.hello.empty()) {
+                handleHello(session, connection.hello);
+            } else if (draining) {
+                release(session);
+            }
+        }
+    }
+
+    Session* sessionFor(int fd) {
+        return fd >= 0 && fd < int(sessions.size()) ? sessions[fd].get() : nullptr;
+    }
+
+    void acceptConnections() {
+        while (true) {
+            int clientSocket = accept4(serverSocket, nullptr, nullptr, SOCK_NONBLOCK);
 
             if (clientSocket < 0) {
-                std::cerr << "Error accepting connection" << std::endl;
-                continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    LOG(WARN) << "Error accepting connection: " << std::strerror(errno);
+                }
+                return;
             }
 
-            std::cout << "New connection accepted" << std::endl;
+            Session* session = addSession(clientSocket);
+            WorkerMetrics::add(metrics.connectionsAccepted);
+            LOG(DEBUG) << "New connection accepted";
 
             // Send welcome message
-            std::string welcomeMsg = "700";
-            send(clientSocket, welcomeMsg.c_str(), welcomeMsg.length(), 0);
-
-            // Receive player info
-            char buffer[256] = {0};
-            if (recv(clientSocket, buffer, sizeof(buffer) - 1, 0) <= 0) {
-                std::cerr << "Error receiving player info" << std::endl;
-                close(clientSocket);
-                continue;
+            queueMessage(session, "700");
+        }
+    }
+
+    Session* addSession(int fd) {
+        if (fd >= int(sessions.size())) {
+            sessions.resize(fd + 1);
+        }
+        sessions[fd].reset(new Session(fd));
+        WorkerMetrics::add(metrics.connectionsOpen);
+
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+        return sessions[fd].get();
+    }
+
+    void handleReadable(Session* session) {
+        int fd = session->fd;
+        ssize_t bytesReceived = session->input.fill(fd);
+        if (bytesReceived < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            return;
+        }
+        if (bytesReceived <= 0) {
+            // End of stream, a read error, or a full ring without a message
+            if (bytesReceived < 0 && errno == ENOBUFS) {
+                WorkerMetrics::add(metrics.protocolErrors);
             }
+            handleDisconnect(session);
+            return;
+        }
+
+        // Several messages may have arrived at once; handling one can end
+        // the game and close this session
+        std::string_view message;
+        while (sessionFor(fd) == session && session->input.next(message)) {
+            handleMessage(session, message);
+        }
+    }
 
-            std::string playerInfo(buffer);
-            std::cout << "Received: " << playerInfo << std::endl;
+    // Takes what the session's channel holds; false if it was empty.
+    bool readChannel(Session* session) {
+        int fd = session->fd;
+        std::string_view message;
+        bool received = false;
+        while (sessionFor(fd) == session && session->channel && session->channel->receive(message)) {
+            received = true;
+            handleMessage(session, message);
+        }
+        if (received) {
+            channelActivity = std::chrono::steady_clock::now();
+        }
+        if (sessionFor(fd) == session && session->channel && session->channel->broken()) {
+            LOG(INFO) << "Corrupt shared-memory channel";
+            WorkerMetrics::add(metrics.protocolErrors);
+            handleDisconnect(session);
+        }
+        return received;
+    }
 
-            // Parse player type and name
-            int playerType;
-            std::string playerName;
-            try {
-                int spacePos = playerInfo.find(' ');
-                playerType = std::stoi(playerInfo.substr(0, spacePos));
-                playerName = playerInfo.substr(spacePos + 1);
-            } catch (const std::exception& e) {
-                std::cerr << "Error parsing player info" << std::endl;
-                close(clientSocket);
-                continue;
+    // Polls every channel for up to spinTime(); true once any had messages.
+    bool pollChannels() {
+        auto deadline = std::chrono::steady_clock::now() + ShmChannel::spinTime();
+        do {
+            bool received = false;
+            for (size_t i = 0; i < channelSessions.size(); i++) {
+                Session* session = sessionFor(channelSessions[i]);
+                if (session && readChannel(session)) received = true;
             }
+            if (received) return true;
+            cpuRelax();
+        } while (std::chrono::steady_clock::now() < deadline);
+        return false;
+    }
 
-            // Check player type
-            if (playerType != 1 && playerType != 2) {
-                std::cerr << "Invalid player type: " << playerType << std::endl;
-                close(clientSocket);
-                continue;
+    // Tells every channel's client to ring the doorbell from now on; false,
+    // with all of them awake again, if a message has already arrived.
+    bool sleepChannels() {
+        bool asleep = true;
+        for (int fd : channelSessions) {
+            if (!sessions[fd]->channel->sleep()) asleep = false;
+        }
+        if (!asleep) wakeChannels();
+        return asleep;
+    }
+
+    void wakeChannels() {
+        for (int fd : channelSessions) {
+            sessions[fd]->channel->wake();
+        }
+    }
+
+    void attachChannel(Session* session, std::shared_ptr<ShmChannel> channel) {
+        session->channel = std::move(channel);
+        channelSessions.push_back(session->fd);
+        channelActivity = std::chrono::steady_clock::now();
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.u64 = uint64_t(session->fd) | DOORBELL;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, session->channel->doorbell(), &event);
+    }
+
+    std::shared_ptr<ShmChannel> detachChannel(Session* session) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, session->channel->doorbell(), nullptr);
+        for (size_t i = 0; i < channelSessions.size(); i++) {
+            if (channelSessions[i] == session->fd) {
+                channelSessions[i] = channelSessions.back();
+                channelSessions.pop_back();
+                break;
             }
+        }
+        return std::move(session->channel);
+    }
+
+    void handleMessage(Session* session, std::string_view message) {
+        switch (session->state) {
+            case Session::AWAIT_HELLO:
+                if (message == ShmChannel::REQUEST) openChannel(session);
+                else handleHello(session, message);
+                break;
+            case Session::PLAYING:
+                handleMove(session, message);
+                break;
+            default:
+                break;  // ignore chatter from waiting or closing clients
+        }
+    }
+
+    // Moves a connection to a new shared-memory channel, at the request of
+    // a client on the Unix socket. The grant is the last message on the
+    // socket itself.
+    void openChannel(Session* session) {
+        if (!localListener || session->channel || !session->output.empty()) {
+            LOG(INFO) << "Shared-memory channel refused";
+            WorkerMetrics::add(metrics.protocolErrors);
+            closeSession(session);
+            return;
+        }
+        std::shared_ptr<ShmChannel> channel;
+        try {
+            channel = ShmChannel::create();
+        } catch (const std::exception& e) {
+            LOG(WARN) << e.what();
+            closeSession(session);
+            return;
+        }
+        if (!channel->grant(session->fd)) {
+            closeSession(session);
+            return;
+        }
+        attachChannel(session, std::move(channel));
+        LOG(DEBUG) << "Connection moved to shared memory";
+    }
+
+    void handleHello(Session* session, std::string_view playerInfo) {
+        LOG(DEBUG) << "Received: " << playerInfo;
+
+        // Parse player type and name
+        int playerType;
+        size_t spacePos = playerInfo.find(' ');
+        auto parsed = std::from_chars(playerInfo.data(), playerInfo.data() + playerInfo.size(), playerType);
+        if (parsed.ec != std::errc() || spacePos == std::string_view::npos) {
+            LOG(INFO) << "Error parsing player info";
+            WorkerMetrics::add(metrics.protocolErrors);
+            closeSession(session);
+            return;
+        }
+        std::string playerName(playerInfo.substr(spacePos + 1));
+
+        if (playerType == 3) {
+            watch(session, playerName);
+            return;
+        }
+
+        // Check player type
+        if (playerType < 0 || playerType > 2) {
+            LOG(INFO) << "Invalid player type: " << playerType;
+            WorkerMetrics::add(metrics.protocolErrors);
+            closeSession(session);
+            return;
+        }
+
+        session->playerType = playerType;
+        session->playerName = playerName;
+        session->rating = ratings.rating(playerName);
+        session->input.setLegacyLength(2);  // bare moves are two digits
+        LOG(DEBUG) << "Player " << playerType << " (" << playerName << ") connected";
+
+        if (draining) {
+            session->state = Session::WAITING;
+            release(session);
+            return;
+        }
+
+        // Pair with a waiting player on this worker, then on the others;
+        // otherwise wait in the lobby
+        Lobby<Session*>::Entry opponent;
+        if (lobby.takeOpponent(playerType, session->rating, opponent)) {
+            pair(opponent.player, session);
+        } else if (!exchange || !adoptOpponentFor(session)) {
+            session->state = Session::WAITING;
+            session->waitingSince = std::chrono::steady_clock::now();
+            lobby.add(session, playerType, session->rating);
+        }
+    }
 
-            // Check if player slot is available
-            int playerIndex = playerType - 1;
-            if (playerConnected[playerIndex]) {
-                std::cerr << "Player slot " << playerType << " already taken" << std::endl;
-                close(clientSocket);
+    // Hands a spectator's connection to the spectator hub. The target is a
+    // game id or "*" for every game.
+    void watch(Session* session, const std::string& target) {
+        uint64_t gameId = SpectatorHub::ALL_GAMES;
+        auto parsed = std::from_chars(target.data(), target.data() + target.size(), gameId);
+        if (target != "*" && (parsed.ec != std::errc() || gameId == SpectatorHub::ALL_GAMES)) {
+            LOG(INFO) << "Invalid spectator target: " << target;
+            WorkerMetrics::add(metrics.protocolErrors);
+            closeSession(session);
+            return;
+        }
+        LOG(DEBUG) << "Spectator connected to " << (gameId == SpectatorHub::ALL_GAMES ? "all games" : "game " + target);
+
+        int fd = session->fd;
+        std::string unsent = std::move(session->output);
+        if (session->channel) {
+            detachChannel(session);  // events are written to the socket
+        }
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+        sessions[fd].reset();
+        WorkerMetrics::add(metrics.connectionsOpen, -1);
+        spectators.subscribe(fd, gameId, std::move(unsent));
+    }
+
+    // Starts a game between a player that was waiting and a newcomer, on the
+    // sides the lobby assigns them.
+    void pair(Session* waitingPlayer, Session* newcomer) {
+        if (assignSide(waitingPlayer->playerType, newcomer->playerType) == 1) {
+            startGame(waitingPlayer, newcomer);
+        } else {
+            startGame(newcomer, waitingPlayer);
+        }
+    }
+
+    // Takes an opponent for `session` from another worker, if one is waiting
+    // there, and starts their game on this worker.
+    bool adoptOpponentFor(Session* session) {
+        Lobby<HandoffPlayer>::Entry opponent;
+        while (exchange->takeOpponent(session->playerType, session->rating, opponent)) {
+            // Skip players that left while nobody was watching their socket
+            char probe;
+            if (recv(opponent.player.fd, &probe, 1, MSG_PEEK | MSG_DONTWAIT) == 0) {
+                close(opponent.player.fd);
                 continue;
             }
 
-            // Register player
-            playerSockets[playerIndex] = clientSocket;
-            playerNames[playerIndex] = playerName;
-            playerConnected[playerIndex] = true;
+            Session* adopted = addSession(opponent.player.fd);
+            if (opponent.player.channel) {
+                attachChannel(adopted, std::move(opponent.player.channel));
+            }
+            adopted->playerType = opponent.side;
+            adopted->playerName = opponent.player.playerName;
+            adopted->rating = opponent.rating;
+            adopted->input.setLegacyLength(2);
+            LOG(DEBUG) << "Worker " << workerIndex << " adopted player " << opponent.side
+                       << " (" << adopted->playerName << ")";
 
-            std::cout << "Player " << playerType << " (" << playerName << ") connected" << std::endl;
+            pair(adopted, session);
+            return true;
         }
+        return false;
+    }
 
-        std::cout << "Both players connected. Starting game..." << std::endl;
+    // Players that found no local opponent within HANDOFF_DELAY_MS either
+    // take one from another worker or are released to the exchange.
+    void handOffWaitingPlayers() {
+        auto cutoff = std::chrono::steady_clock::now() - std::chrono::milliseconds(HANDOFF_DELAY_MS);
+        while (!lobby.empty() && lobby.oldest().player->waitingSince <= cutoff) {
+            Session* session = lobby.oldest().player;
+            lobby.remove(session);
+            if (adoptOpponentFor(session)) continue;
+
+            int fd = session->fd;
+            std::shared_ptr<ShmChannel> channel;
+            if (session->channel) {
+                channel = detachChannel(session);
+            }
+            exchange->publish(HandoffPlayer{fd, session->playerName, std::move(channel)}, session->playerType,
+                              session->rating);
+            epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+            sessions[fd].reset();
+            WorkerMetrics::add(metrics.connectionsOpen, -1);
+        }
     }
 
-    void playGame() {
-        board.reset();
-        moveCounter = 0;
-        currentPlayer = 0; // Player 1 starts
+    void startGame(Session* first, Session* second) {
+        std::unique_ptr<Game> game(new Game());
+        game->id = nextGameId;
+        nextGameId += workerCount;  // ids stay unique across workers
+        game->players[0] = first;
+        game->players[1] = second;
+        game->playerNames[0] = first->playerName;
+        game->playerNames[1] = second->playerName;
+        game->board = GameBoard(variant);
+        game->currentPlayer = 0;  // Player 1 starts
+        game->moveCounter = 0;
+        game->record = GameRecord();
+        game->record.boardSize = uint8_t(game->board.size());
+        game->record.startMicros = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        game->record.setName(0, first->playerName);
+        game->record.setName(1, second->playerName);
+        game->startTime = std::chrono::steady_clock::now();
+
+        first->state = Session::PLAYING;
+        first->game = game.get();
+        second->state = Session::PLAYING;
+        second->game = game.get();
+
+        LOG(DEBUG) << "Game " << game->id << ": " << first->playerName << " vs " << second->playerName
+                   << ". Starting game...";
 
         // Notify first player to make a move
-        std::string firstMoveMsg = "600";
-        send(playerSockets[currentPlayer], firstMoveMsg.c_str(), firstMoveMsg.length(), 0);
+        queueMessage(first, "600");
+        game->promptTime = std::chrono::steady_clock::now();
+        if (timeControl.enabled()) {
+            game->remaining[0] = game->remaining[1] = timeControl.initial;
+            game->clockTimer.owner = game.get();
+            startClock(game.get());
+        }
+        spectators.gameStarted(game->id);
+        if (spectators.watching()) {
+            spectators.publish(game->id, "800 " + std::to_string(game->id) + " " + first->playerName + " " +
+                                             second->playerName);
+        }
+        games[game->id] = std::move(game);
+        WorkerMetrics::add(metrics.gamesStarted);
+        metrics.gamesActive.store(games.size(), std::memory_order_relaxed);
+    }
 
-        while (moveCounter < 25) {
-            // Receive move from current player
-            char buffer[16] = {0};
+    void handleMove(Session* session, std::string_view moveStr) {
+        Game* game = session->game;
+        int player = game->players[0] == session ? 0 : 1;
+        LOG(DEBUG) << "Game " << game->id << ": Player " << player + 1 << " move: " << moveStr;
 
-            int bytesReceived = recv(playerSockets[currentPlayer], buffer, sizeof(buffer) - 1, 0);
-            if (bytesReceived <= 0) {
-                std::cerr << "Player " << currentPlayer + 1 << " disconnected" << std::endl;
-                endGame(1 - currentPlayer, 4); // Other player wins due to disconnect
-                return;
-            }
+        if (player != game->currentPlayer) {
+            LOG(INFO) << "Game " << game->id << ": move out of turn from player " << player + 1;
+            WorkerMetrics::add(metrics.protocolErrors);
+            endGame(game, 1 - player, 4, LOG_ILLEGAL_MOVE); // Player loses due to error
+            return;
+        }
 
-            std::string moveStr(buffer);
-            std::cout << "Player " << currentPlayer + 1 << " move: " << moveStr << std::endl;
+        auto now = std::chrono::steady_clock::now();
+        auto thinkTime = now - game->promptTime;
+        metrics.recordThinkTime(std::chrono::duration_cast<std::chrono::microseconds>(thinkTime).count());
 
-            int move;
-            try {
-                move = std::stoi(moveStr);
-            } catch (const std::exception& e) {
-                std::cerr << "Invalid move format from player " << currentPlayer + 1 << std::endl;
-                endGame(1 - currentPlayer, 4); // Player loses due to error
-                return;
+        // A move that arrives after the flag fell loses, even before the timer has fired
+        if (timeControl.enabled()) {
+            bool flagged;
+            if (timeControl.perMove.count() > 0) {
+                flagged = thinkTime > timeControl.perMove;
+            } else {
+                game->remaining[player] -= thinkTime;
+                flagged = game->remaining[player] < thinkTime.zero();
             }
-
-            // Process move
-            if (!board.placeMove(move, currentPlayer + 1)) {
-                std::cerr << "Invalid move from player " << currentPlayer + 1 << std::endl;
-                endGame(1 - currentPlayer, 4); // Player loses due to error
+            if (flagged) {
+                flagFall(game);
                 return;
             }
+            game->remaining[player] += timeControl.increment;
+        }
 
-            moveCounter++;
-            board.display();
+        int move;
+        auto parsed = std::from_chars(moveStr.data(), moveStr.data() + moveStr.size(), move);
+        if (parsed.ec != std::errc()) {
+            LOG(INFO) << "Game " << game->id << ": invalid move format from player " << player + 1;
+            WorkerMetrics::add(metrics.protocolErrors);
+            endGame(game, 1 - player, 4, LOG_ILLEGAL_MOVE); // Player loses due to error
+            return;
+        }
 
-            // Check for win/lose conditions
-            if (board.checkWin(currentPlayer + 1)) {
-                std::cout << "Player " << currentPlayer + 1 << " wins by making 4 in a row" << std::endl;
-                endGame(currentPlayer, 1); // Current player wins
-                return;
-            }
+        // Process move
+        if (!game->board.placeMove(move, player + 1)) {
+            LOG(INFO) << "Game " << game->id << ": invalid move from player " << player + 1;
+            WorkerMetrics::add(metrics.protocolErrors);
+            endGame(game, 1 - player, 4, LOG_ILLEGAL_MOVE); // Player loses due to error
+            return;
+        }
 
-            if (board.checkLose(currentPlayer + 1)) {
-                std::cout << "Player " << currentPlayer + 1 << " loses by making forbidden 3 in a row" << std::endl;
-                endGame(1 - currentPlayer, 1); // Current player loses
-                return;
-            }
+        game->record.moves[game->moveCounter] = uint8_t((move / 10 - 1) * game->board.size() + move % 10 - 1);
+        game->moveCounter++;
+        WorkerMetrics::add(metrics.moves);
+        if (logger.enabled(LogLevel::DEBUG)) {
+            std::ostringstream board;
+            game->board.display(board);
+            LOG(DEBUG) << "Game " << game->id << ":\n" << board.str();
+        }
+        if (spectators.watching()) {
+            publishMove(game, player, move);
+        }
 
-            // Check for draw
-            if (moveCounter == 25) {
-                std::cout << "Draw - board is full" << std::endl;
-                endGame(-1, 3); // Draw
-                return;
-            }
+        // Check for win/lose conditions
+        if (game->board.checkWin(player + 1)) {
+            LOG(DEBUG) << "Game " << game->id << ": player " << player + 1 << " wins by making 4 in a row";
+            endGame(game, player, 1, LOG_FOUR_IN_A_ROW); // Current player wins
+            return;
+        }
+
+        if (game->board.checkLose(player + 1)) {
+            LOG(DEBUG) << "Game " << game->id << ": player " << player + 1 << " loses by making forbidden 3 in a row";
+            endGame(game, 1 - player, 1, LOG_FORBIDDEN_THREE); // Current player loses
+            return;
+        }
+
+        // Check for draw
+        if (game->moveCounter == game->board.cellCount()) {
+            LOG(DEBUG) << "Game " << game->id << ": draw - board is full";
+            endGame(game, -1, 3, LOG_FULL_BOARD); // Draw
+            return;
+        }
+
+        // Send move notification to next player
+        game->currentPlayer = 1 - player;
+        queueMessage(game->players[game->currentPlayer], "0" + std::to_string(move));
+        game->promptTime = now;
+        if (timeControl.enabled()) {
+            startClock(game);
+        }
+    }
 
-            // Switch to other player
-            int nextPlayer = 1 - currentPlayer;
+    // Arms the timer for the player to move, from the time they were prompted.
+    void startClock(Game* game) {
+        auto allowed = timeControl.perMove.count() > 0 ? std::chrono::steady_clock::duration(timeControl.perMove)
+                                                       : game->remaining[game->currentPlayer];
+        clocks.schedule(&game->clockTimer, game->promptTime + allowed);
+    }
+
+    // The player to move ran out of time.
+    void flagFall(Game* game) {
+        LOG(INFO) << "Game " << game->id << ": player " << game->currentPlayer + 1 << " lost on time";
+        WorkerMetrics::add(metrics.timeForfeits);
+        endGame(game, 1 - game->currentPlayer, 4, LOG_TIME_FORFEIT);
+    }
 
-            // Send move notification to next player
-            std::string notification = "0" + std::to_string(move);
-            send(playerSockets[nextPlayer], notification.c_str(), notification.length(), 0);
+    void handleDisconnect(Session* session) {
+        if (session->state != Session::CLOSING) {
+            WorkerMetrics::add(metrics.disconnects);
+        }
+        if (session->state == Session::PLAYING) {
+            Game* game = session->game;
+            int player = game->players[0] == session ? 0 : 1;
+            LOG(INFO) << "Game " << game->id << ": player " << player + 1 << " disconnected";
+            game->players[player] = nullptr;
+            endGame(game, 1 - player, 4, LOG_DISCONNECT); // Other player wins due to disconnect
+        } else if (session->state == Session::WAITING) {
+            lobby.remove(session);
+        }
+        closeSession(session);
+    }
 
-            currentPlayer = nextPlayer;
+    void publishMove(Game* game, int player, int move) {
+        std::string event = "810 " + std::to_string(game->id) + " " + std::to_string(player + 1) + " " +
+                            std::to_string(move) + " ";
+        for (int row = 0; row < game->board.size(); row++) {
+            for (int col = 0; col < game->board.size(); col++) {
+                event += "-XO"[game->board.getCellValue(row, col)];
+            }
         }
+        spectators.publish(game->id, std::move(event));
     }
 
-    void endGame(int winningPlayer, int statusCode) {
+    void endGame(Game* game, int winningPlayer, int statusCode, GameLogReason reason) {
+        clocks.cancel(&game->clockTimer);
         if (statusCode == 3) {
             // Draw
-            std::string drawMsg = "300";
-            send(playerSockets[0], drawMsg.c_str(), drawMsg.length(), 0);
-            send(playerSockets[1], drawMsg.c_str(), drawMsg.length(), 0);
+            notify(game->players[0], "300");
+            notify(game->players[1], "300");
         }
         else if (statusCode == 4) {
             // Player error - disconnect or invalid move
-            int losingPlayer = 1 - winningPlayer;
-
-            std::string winMsg = "400";
-            std::string loseMsg = "500";
-            send(playerSockets[winningPlayer], winMsg.c_str(), winMsg.length(), 0);
-            if (playerSockets[losingPlayer] >= 0) {
-                send(playerSockets[losingPlayer], loseMsg.c_str(), loseMsg.length(), 0);
-            }
+            notify(game->players[winningPlayer], "400");
+            notify(game->players[1 - winningPlayer], "500");
         }
         else {
             // Regular win/loss (status code 1)
-            int losingPlayer = 1 - winningPlayer;
+            notify(game->players[winningPlayer], "100");
+            notify(game->players[1 - winningPlayer], "200");
+        }
+
+        int result = statusCode == 3 ? LOG_DRAW : (winningPlayer == 0 ? LOG_X_WINS : LOG_O_WINS);
+        spectators.gameEnded(game->id);
+        if (spectators.watching()) {
+            spectators.publish(game->id, "820 " + std::to_string(game->id) + " " + std::to_string(result) + " " +
+                                             std::to_string(int(reason)), true);
+        }
 
-            std::string winMsg = "100";
-            std::string loseMsg = "200";
+        double score = statusCode == 3 ? 0.5 : (winningPlayer == 0 ? 1.0 : 0.0);
+        if (results) {
+            results->record(game->playerNames[0], game->playerNames[1], score);
+        } else {
+            ratings.recordGame(game->playerNames[0], game->playerNames[1], score);
+        }
 
-            send(playerSockets[winningPlayer], winMsg.c_str(), winMsg.length(), 0);
-            send(playerSockets[losingPlayer], loseMsg.c_str(), loseMsg.length(), 0);
+        if (gameLog) {
+            GameRecord& record = game->record;
+            record.moveCount = uint8_t(game->moveCounter);
+            record.result = uint8_t(result);
+            record.reason = reason;
+            record.durationMs = uint32_t(std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - game->startTime).count());
+            gameLog->append(record);
         }
+
+        // Connections close once the result has been flushed
+        for (Session* player : game->players) {
+            if (player) {
+                player->game = nullptr;
+                player->state = Session::CLOSING;
+                if (player->output.empty()) closeSession(player);
+            }
+        }
+        LOG(DEBUG) << "Game " << game->id << " ended";
+        games.erase(game->id);
+        WorkerMetrics::add(metrics.gamesCompleted);
+        metrics.gamesActive.store(games.size(), std::memory_order_relaxed);
     }
 
-    void resetGame() {
-        std::cout << "Game ended. Waiting 5 seconds before resetting..." << std::endl;
-        sleep(5);
+    void notify(Session* session, const std::string& message) {
+        if (session) queueMessage(session, message);
+    }
 
-        close(playerSockets[0]);
-        close(playerSockets[1]);
-        playerSockets[0] = -1;
-        playerSockets[1] = -1;
-        playerConnected[0] = false;
-        playerConnected[1] = false;
+    void queueMessage(Session* session, const std::string& message) {
+        if (!session->channel) {
+            appendFrame(session->output, message);
+        } else if (!session->channel->send(message)) {
+            // A ring holds many games' messages; the client has stopped
+            // reading, and the read side reports the disconnect
+            shutdown(session->fd, SHUT_RDWR);
+        }
+        flush(session);
+    }
+
+    void flush(Session* session) {
+        while (!session->output.empty()) {
+            ssize_t sent = send(session->fd, session->output.data(), session->output.size(), MSG_NOSIGNAL);
+            if (sent < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                session->output.clear();  // peer is gone; the read side reports the disconnect
+                break;
+            }
+            session->output.erase(0, sent);
+        }
+
+        bool wantWrite = !session->output.empty();
+        if (wantWrite != session->wantWrite) {
+            struct epoll_event event = {};
+            event.events = wantWrite ? EPOLLIN | EPOLLOUT : EPOLLIN;
+            event.data.fd = session->fd;
+            epoll_ctl(epollFd, EPOLL_CTL_MOD, session->fd, &event);
+            session->wantWrite = wantWrite;
+        }
+
+        if (session->state == Session::CLOSING && session->output.empty()) {
+            closeSession(session);
+        }
+    }
+
+    void closeSession(Session* session) {
+        int fd = session->fd;
+        if (session->channel) {
+            detachChannel(session);
+        }
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+        sessions[fd].reset();
+        WorkerMetrics::add(metrics.connectionsOpen, -1);
     }
 };
 
+// Waits on the control socket for a new process to take over, then sends it
+// the listening sockets and starts draining. Returns once draining has
+// started for any reason.
+static void serveControl(int listener, const std::string& path, const std::vector<int>& listenFds) {
+    struct pollfd watched[2] = {{listener, POLLIN, 0}, {drainEvent, POLLIN, 0}};
+    while (poll(watched, 2, -1) >= 0 || errno == EINTR) {
+        if (watched[1].revents) return;
+        if (!watched[0].revents) continue;
+        int connection = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (connection < 0) continue;
+
+        std::string request;
+        std::vector<int> fds;
+        if (!receiveHandover(connection, request, fds) || request != "TAKEOVER") {
+            for (int fd : fds) close(fd);
+            close(connection);
+            continue;
+        }
+        unlink(path.c_str());  // the new process serves the control path from now on
+        successorSocket = connection;
+        if (!sendHandover(connection, "LISTEN", listenFds) || !requestDrain(HANDOVER)) {
+            successorSocket = -1;
+            close(connection);
+            continue;
+        }
+        LOG(INFO) << "Handing over to a new server process";
+        return;
+    }
+}
+
+// Takes the listening sockets of the server at `path`.
+static int takeOver(const std::string& path, std::vector<int>& listenFds) {
+    int predecessor = connectControl(path);
+    std::string reply;
+    if (!sendHandover(predecessor, "TAKEOVER") || !receiveHandover(predecessor, reply, listenFds) ||
+        reply != "LISTEN" || listenFds.empty()) {
+        close(predecessor);
+        throw std::runtime_error("Takeover refused by " + path);
+    }
+    return predecessor;
+}
+
+// Receives the waiting players of the server being replaced and spreads
+// them over the workers, until it is done or this server starts draining.
+static void receivePlayers(int predecessor, std::vector<std::unique_ptr<GameServer>>& servers) {
+    size_t next = 0;
+    int adopted = 0;
+    struct pollfd watched[2] = {{predecessor, POLLIN, 0}, {drainEvent, POLLIN, 0}};
+    while (poll(watched, 2, -1) >= 0 || errno == EINTR) {
+        if (watched[1].revents) break;
+        if (!watched[0].revents) continue;
+        std::string message;
+        std::vector<int> fds;
+        if (!receiveHandover(predecessor, message, fds) || message == "DONE") break;
+        if (fds.size() != 1 && fds.size() != 4) {
+            for (int fd : fds) close(fd);
+            continue;
+        }
+        std::shared_ptr<ShmChannel> channel;
+        if (fds.size() == 4) {
+            try {
+                channel = std::make_shared<ShmChannel>(ShmChannel::SERVER, fds[1], fds[2], fds[3]);
+            } catch (const std::exception& e) {
+                LOG(WARN) << e.what();
+                close(fds[0]);
+                continue;
+            }
+        }
+        std::string hello = message.compare(0, 7, "PLAYER ") == 0 ? message.substr(7) : "";
+        servers[next++ % servers.size()]->adopt(fds[0], hello, std::move(channel));
+        adopted++;
+    }
+    LOG(INFO) << "Adopted " << adopted << " connections from the previous server";
+    close(predecessor);
+}
+
 int main(int argc, char *argv[]) {
-    if (argc != 3) {
-        std::cerr << "Usage: " << argv[0] << " <IP> <PORT>" << std::endl;
+    int workers = 1;
+    PairingPolicy pairing = PairingPolicy::SIDE;
+    bool validPairing = true;
+    std::string gameLogBase;
+    std::string resultsPath;
+    std::string controlPath;
+    std::string takeoverPath;
+    int gameLogMb = 64;
+    int metricsPort = 0;
+    int spectatorBufferKb = 256;
+    TimeControl timeControl;
+    bool validClock = true;
+    LogLevel logLevel = LogLevel::INFO;
+    bool validLogLevel = true;
+    int variant = DEFAULT_VARIANT;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--workers" && i + 1 < argc) {
+            workers = std::atoi(argv[++i]);
+        } else if (arg == "--pairing" && i + 1 < argc) {
+            validPairing = parsePairingPolicy(argv[++i], pairing);
+        } else if (arg == "--metrics-port" && i + 1 < argc) {
+            metricsPort = std::atoi(argv[++i]);
+        } else if (arg == "--log-level" && i + 1 < argc) {
+            validLogLevel = parseLogLevel(argv[++i], logLevel);
+        } else if (arg == "--control" && i + 1 < argc) {
+            controlPath = argv[++i];
+        } else if (arg == "--takeover" && i + 1 < argc) {
+            takeoverPath = argv[++i];
+        } else if (arg == "--results" && i + 1 < argc) {
+            resultsPath = argv[++i];
+        } else if (arg == "--game-log" && i + 1 < argc) {
+            gameLogBase = argv[++i];
+        } else if (arg == "--clock" && i + 1 < argc) {
+            validClock = parseClock(argv[++i], timeControl) && timeControl.perMove.count() == 0;
+        } else if (arg == "--move-time" && i + 1 < argc) {
+            timeControl.perMove = std::chrono::milliseconds(std::atoi(argv[++i]));
+            validClock = timeControl.perMove.count() > 0 && timeControl.initial.count() == 0;
+        } else if (arg == "--spectator-buffer-kb" && i + 1 < argc) {
+            spectatorBufferKb = std::atoi(argv[++i]);
+        } else if (arg == "--game-log-mb" && i + 1 < argc) {
+            gameLogMb = std::atoi(argv[++i]);
+        } else if (arg == "--variant" && i + 1 < argc) {
+            variant = findVariant(argv[++i]);
+        } else {
+            args.push_back(arg);
+        }
+    }
+    if (args.size() != 2 || workers < 1 || !validPairing || gameLogMb < 1 || !validLogLevel ||
+        spectatorBufferKb < 1 || !validClock || variant < 0) {
+        std::cerr << "Usage: " << argv[0] << " <IP|unix:PATH> <PORT> [--workers N] [--pairing side|fifo|rating]"
+                  << " [--game-log BASE [--game-log-mb N]] [--metrics-port PORT]"
+                  << " [--log-level debug|info|warn|error|off] [--spectator-buffer-kb N]"
+                  << " [--clock SECONDS[+INCREMENT] | --move-time MS] [--results PATH]"
+                  << " [--control PATH] [--takeover PATH] [--variant NAME]" << std::endl;
+        std::cerr << "  variants: " << VARIANT_NAMES << " (default " << VARIANTS[DEFAULT_VARIANT].name << ")"
+                  << std::endl;
         return 1;
     }
 
-    std::string ip = argv[1];
+    std::string ip = args[0];
     int port;
     try {
-        port = std::stoi(argv[2]);
+        port = std::stoi(args[1]);
     } catch (const std::exception& e) {
         std::cerr << "Invalid port number" << std::endl;
         return 1;
     }
 
     try {
-        GameServer server(ip, port);
-        server.run();
+        logger.setLevel(logLevel);
+        drainEvent = eventfd(0, EFD_CLOEXEC);
+        if (drainEvent < 0) {
+            throw std::runtime_error("Failed to create drain event");
+        }
+        struct sigaction stop = {};
+        stop.sa_handler = onStopSignal;
+        sigaction(SIGTERM, &stop, nullptr);
+        sigaction(SIGINT, &stop, nullptr);
+
+        // A takeover brings one listener per worker of the old process
+        std::vector<int> inherited;
+        int predecessor = -1;
+        if (!takeoverPath.empty()) {
+            predecessor = takeOver(takeoverPath, inherited);
+            workers = int(inherited.size());
+            if (controlPath.empty()) controlPath = takeoverPath;
+        }
+
+        // Bind every listener before serving, so a bad address fails fast
+        ServerShared shared(workers, pairing, size_t(spectatorBufferKb) << 10);
+        if (isUnixAddress(ip) && predecessor < 0) {
+            shared.sharedListener = listenOn(ip, port, false);
+        }
+        shared.timeControl = timeControl;
+        shared.variant = variant;
+        if (!resultsPath.empty()) {
+            shared.results.reset(new ResultStore(shared.ratings, resultsPath));
+        }
+        shared.gameLogBase = gameLogBase;
+        shared.gameLogBytes = size_t(gameLogMb) << 20;
+        std::vector<std::unique_ptr<GameServer>> servers;
+        for (int i = 0; i < workers; i++) {
+            servers.emplace_back(new GameServer(ip, port, i, shared, predecessor >= 0 ? inherited[i] : -1));
+        }
+        if (shared.sharedListener >= 0) {
+            close(shared.sharedListener);  // each worker holds its own descriptor for it
+        }
+        std::thread receiver;
+        if (predecessor >= 0) {
+            receiver = std::thread(receivePlayers, predecessor, std::ref(servers));
+        }
+        std::thread control;
+        int controlListener = -1;
+        if (!controlPath.empty()) {
+            std::vector<int> listenFds;
+            for (auto& server : servers) {
+                listenFds.push_back(server->listenSocket());
+            }
+            controlListener = listenControl(controlPath);
+            control = std::thread(serveControl, controlListener, controlPath, listenFds);
+        }
+
+        std::unique_ptr<MetricsServer> metricsServer;
+        if (metricsPort > 0) {
+            std::vector<WorkerMetrics*> workerMetrics;
+            for (auto& server : servers) {
+                workerMetrics.push_back(&server->workerMetrics());
+            }
+            metricsServer.reset(new MetricsServer(metricsPort, workerMetrics));
+            LOG(INFO) << "Metrics on 127.0.0.1:" << metricsPort;
+        }
+
+        std::vector<std::thread> threads;
+        for (int i = 1; i < workers; i++) {
+            threads.emplace_back([&servers, i]() {
+                try {
+                    servers[i]->run();
+                } catch (const std::exception& e) {
+                    LOG(ERROR) << "Worker " << i << " error: " << e.what();
+                }
+            });
+        }
+        servers[0]->run();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        // Players other workers had published are handed over or dropped too
+        for (auto& waiting : shared.exchange.takeAll()) {
+            if (drainMode.load() == HANDOVER) {
+                std::vector<int> fds = {waiting.player.fd};
+                if (waiting.player.channel) {
+                    for (int fd : waiting.player.channel->descriptors()) fds.push_back(fd);
+                }
+                sendHandover(successorSocket, "PLAYER " + std::to_string(waiting.side) + " " +
+                                                  waiting.player.playerName, fds);
+            }
+            close(waiting.player.fd);
+        }
+        if (successorSocket >= 0) {
+            sendHandover(successorSocket, "DONE");
+            close(successorSocket);
+        }
+        if (receiver.joinable()) receiver.join();
+        if (control.joinable()) {
+            control.join();
+            close(controlListener);
+            if (drainMode.load() == SHUTDOWN) unlink(controlPath.c_str());
+        }
+        if (isUnixAddress(ip) && drainMode.load() == SHUTDOWN) {
+            unlink(ip.c_str() + 5);  // a successor keeps serving the path
+        }
+        LOG(INFO) << "Server stopped";
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
         return 1;
     }
 
     return 0;
-}
\ No newline at end of file
+}
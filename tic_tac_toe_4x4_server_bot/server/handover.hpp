@@ -0,0 +1,117 @@
+#pragma once
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Hot restart. A new server process connects to the control socket of the
+// running one and takes over its listening sockets and waiting players,
+// passed as descriptors (SCM_RIGHTS), while the old process finishes its
+// games. The control socket is SOCK_SEQPACKET, so each message arrives
+// whole, with its descriptors:
+//     TAKEOVER               new -> old: asks for everything
+//     LISTEN                 old -> new: the listening sockets, one per worker
+//     PLAYER <type> <name>   old -> new: a player waiting for an opponent
+//     CONNECTED              old -> new: a connection that has not sent its hello yet
+//     DONE                   old -> new: nothing more to come
+// A connection on a shared-memory channel comes with the channel's three
+// descriptors after its socket.
+
+constexpr size_t HANDOVER_MAX_FDS = 250;  // below the kernel's SCM_MAX_FD
+
+inline bool sendHandover(int socket, const std::string& text, const std::vector<int>& fds = {}) {
+    struct iovec part = {const_cast<char*>(text.data()), text.size()};
+    struct msghdr message = {};
+    message.msg_iov = &part;
+    message.msg_iovlen = 1;
+
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * fds.size()));
+    if (!fds.empty()) {
+        message.msg_control = control.data();
+        message.msg_controllen = control.size();
+        struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+        std::memcpy(CMSG_DATA(header), fds.data(), sizeof(int) * fds.size());
+    }
+    while (true) {
+        ssize_t sent = sendmsg(socket, &message, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) continue;
+        return sent == ssize_t(text.size());
+    }
+}
+
+// Blocks for the next message; false once the peer is gone.
+inline bool receiveHandover(int socket, std::string& text, std::vector<int>& fds) {
+    char buffer[512];
+    struct iovec part = {buffer, sizeof(buffer)};
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * HANDOVER_MAX_FDS));
+    struct msghdr message = {};
+    message.msg_iov = &part;
+    message.msg_iovlen = 1;
+    message.msg_control = control.data();
+    message.msg_controllen = control.size();
+
+    ssize_t received;
+    do {
+        received = recvmsg(socket, &message, MSG_CMSG_CLOEXEC);
+    } while (received < 0 && errno == EINTR);
+    if (received <= 0) {
+        return false;
+    }
+
+    text.assign(buffer, size_t(received));
+    fds.clear();
+    for (struct cmsghdr* header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header)) {
+        if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS) {
+            size_t count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            size_t first = fds.size();
+            fds.resize(first + count);
+            std::memcpy(&fds[first], CMSG_DATA(header), sizeof(int) * count);
+        }
+    }
+    return true;
+}
+
+inline struct sockaddr_un controlAddress(const std::string& path) {
+    struct sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Control socket path too long: " + path);
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+
+// Listens on `path`, replacing a stale socket file.
+inline int listenControl(const std::string& path) {
+    struct sockaddr_un address = controlAddress(path);
+    int listener = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (listener < 0) {
+        throw std::runtime_error("Failed to create control socket");
+    }
+    unlink(path.c_str());
+    if (bind(listener, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(listener, 4) < 0) {
+        close(listener);
+        throw std::runtime_error("Cannot listen on control socket " + path + ": " + std::strerror(errno));
+    }
+    return listener;
+}
+
+inline int connectControl(const std::string& path) {
+    struct sockaddr_un address = controlAddress(path);
+    int connection = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (connection < 0) {
+        throw std::runtime_error("Failed to create control socket");
+    }
+    if (connect(connection, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        close(connection);
+        throw std::runtime_error("Cannot connect to control socket " + path + ": " + std::strerror(errno));
+    }
+    return connection;
+}
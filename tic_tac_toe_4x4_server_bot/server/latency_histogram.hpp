@@ -0,0 +1,97 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+// Histogram of latencies in microseconds with log-linear buckets: values
+// below 32 are exact, larger ones fall into 32 buckets per power of two, so
+// percentiles are within about 3% of the true value. Fixed size, no
+// allocation, cheap enough to record every message.
+class LatencyHistogram {
+private:
+    static constexpr int SUB_BITS = 5;
+    static constexpr int SUB_BUCKETS = 1 << SUB_BITS;
+    static constexpr int BUCKETS = SUB_BUCKETS * (64 - SUB_BITS + 1);
+
+    std::array<uint64_t, BUCKETS> counts;
+    uint64_t total;
+    uint64_t sum;
+    uint64_t maximum;
+
+    static int bucketFor(uint64_t value) {
+        if (value < SUB_BUCKETS) {
+            return int(value);
+        }
+        int exponent = 63 - __builtin_clzll(value);          // >= SUB_BITS
+        int shift = exponent - SUB_BITS;
+        int sub = int(value >> shift) & (SUB_BUCKETS - 1);
+        return (shift + 1) * SUB_BUCKETS + sub;
+    }
+
+    // Largest value that falls into `bucket`.
+    static uint64_t bucketLimit(int bucket) {
+        if (bucket < SUB_BUCKETS) {
+            return uint64_t(bucket);
+        }
+        int shift = bucket / SUB_BUCKETS - 1;
+        uint64_t base = uint64_t(SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+        return base + ((uint64_t(1) << shift) - 1);
+    }
+
+public:
+    LatencyHistogram() {
+        clear();
+    }
+
+    void clear() {
+        counts.fill(0);
+        total = 0;
+        sum = 0;
+        maximum = 0;
+    }
+
+    void record(uint64_t micros) {
+        counts[bucketFor(micros)]++;
+        total++;
+        sum += micros;
+        maximum = std::max(maximum, micros);
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (int i = 0; i < BUCKETS; i++) {
+            counts[i] += other.counts[i];
+        }
+        total += other.total;
+        sum += other.sum;
+        maximum = std::max(maximum, other.maximum);
+    }
+
+    uint64_t count() const {
+        return total;
+    }
+
+    uint64_t max() const {
+        return maximum;
+    }
+
+    double mean() const {
+        return total > 0 ? double(sum) / total : 0.0;
+    }
+
+    // Smallest bucket limit with at least `fraction` of the samples at or
+    // below it, e.g. 0.99 for p99. Never more than the largest sample.
+    uint64_t percentile(double fraction) const {
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t rank = std::max<uint64_t>(1, uint64_t(fraction * total + 0.5));
+        uint64_t seen = 0;
+        for (int i = 0; i < BUCKETS; i++) {
+            seen += counts[i];
+            if (seen >= rank) {
+                return std::min(bucketLimit(i), maximum);
+            }
+        }
+        return maximum;
+    }
+};
@@ -0,0 +1,147 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <vector>
+
+// How the lobby pairs waiting players.
+enum class PairingPolicy {
+    SIDE,    // an X with an O in arrival order; players asking for any side fill either
+    FIFO,    // the longest-waiting player, whatever side either asked for
+    RATING   // like SIDE, but the waiting player with the closest rating
+};
+
+inline bool parsePairingPolicy(const std::string& name, PairingPolicy& policy) {
+    if (name == "side") policy = PairingPolicy::SIDE;
+    else if (name == "fifo") policy = PairingPolicy::FIFO;
+    else if (name == "rating") policy = PairingPolicy::RATING;
+    else return false;
+    return true;
+}
+
+// Requested sides are 1 (X), 2 (O) or 0 (any). Returns the side assigned to
+// the player that was already waiting: its own request wins, then the
+// newcomer's, and with no preference on either side it plays X.
+inline int assignSide(int waitingSide, int newSide) {
+    if (waitingSide != 0) return waitingSide;
+    if (newSide != 0) return 3 - newSide;
+    return 1;
+}
+
+// Players waiting for an opponent. Entries are kept in one arrival-ordered
+// list per requested side, so with the SIDE and FIFO policies the opponent
+// is found by looking at no more than three list heads.
+template <typename Player>
+class Lobby {
+public:
+    struct Entry {
+        Player player;
+        int side;
+        double rating;
+        uint64_t sequence;
+    };
+
+private:
+    PairingPolicy policy;
+    std::list<Entry> queues[3];  // by requested side
+    uint64_t nextSequence;
+    size_t count;
+
+    bool compatible(int waitingSide, int newSide) const {
+        return policy == PairingPolicy::FIFO || waitingSide == 0 || newSide == 0 || waitingSide != newSide;
+    }
+
+public:
+    explicit Lobby(PairingPolicy pairing = PairingPolicy::SIDE)
+        : policy(pairing), nextSequence(0), count(0) {}
+
+    void setPolicy(PairingPolicy pairing) {
+        policy = pairing;
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    // The longest-waiting entry; the lobby must not be empty.
+    const Entry& oldest() const {
+        const Entry* best = nullptr;
+        for (const auto& queue : queues) {
+            if (!queue.empty() && (!best || queue.front().sequence < best->sequence)) {
+                best = &queue.front();
+            }
+        }
+        return *best;
+    }
+
+    void add(const Player& player, int side, double rating) {
+        queues[side].push_back(Entry{player, side, rating, nextSequence++});
+        count++;
+    }
+
+    // Empties the lobby, returning every entry in no particular order.
+    std::vector<Entry> takeAll() {
+        std::vector<Entry> entries;
+        entries.reserve(count);
+        for (auto& queue : queues) {
+            entries.insert(entries.end(), queue.begin(), queue.end());
+            queue.clear();
+        }
+        count = 0;
+        return entries;
+    }
+
+    bool remove(const Player& player) {
+        for (auto& queue : queues) {
+            for (auto it = queue.begin(); it != queue.end(); ++it) {
+                if (it->player == player) {
+                    queue.erase(it);
+                    count--;
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    // Removes and returns the opponent the policy picks for a player asking
+    // for `side` with `rating`, or returns false if nobody suitable waits.
+    bool takeOpponent(int side, double rating, Entry& opponent) {
+        std::list<Entry>* bestQueue = nullptr;
+        typename std::list<Entry>::iterator best;
+
+        for (int waitingSide = 0; waitingSide < 3; waitingSide++) {
+            auto& queue = queues[waitingSide];
+            if (queue.empty() || !compatible(waitingSide, side)) continue;
+
+            if (policy != PairingPolicy::RATING) {
+                if (!bestQueue || queue.front().sequence < best->sequence) {
+                    bestQueue = &queue;
+                    best = queue.begin();
+                }
+                continue;
+            }
+            for (auto it = queue.begin(); it != queue.end(); ++it) {
+                double gap = std::fabs(it->rating - rating);
+                if (!bestQueue || gap < std::fabs(best->rating - rating) ||
+                    (gap == std::fabs(best->rating - rating) && it->sequence < best->sequence)) {
+                    bestQueue = &queue;
+                    best = it;
+                }
+            }
+        }
+
+        if (!bestQueue) {
+            return false;
+        }
+        opponent = *best;
+        bestQueue->erase(best);
+        count--;
+        return true;
+    }
+};
@@ -0,0 +1,128 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <ctime>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Asynchronous, level-filtered logging. A disabled level costs one
+// comparison; an enabled line is formatted by the caller and handed to a
+// background thread, which writes queued lines to stderr in batches.
+//
+//     LOG(INFO) << "Game " << id << " ended";
+
+enum class LogLevel { DEBUG, INFO, WARN, ERROR, OFF };
+
+inline bool parseLogLevel(const std::string& name, LogLevel& level) {
+    if (name == "debug") level = LogLevel::DEBUG;
+    else if (name == "info") level = LogLevel::INFO;
+    else if (name == "warn") level = LogLevel::WARN;
+    else if (name == "error") level = LogLevel::ERROR;
+    else if (name == "off") level = LogLevel::OFF;
+    else return false;
+    return true;
+}
+
+class Logger {
+private:
+    LogLevel level;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::vector<std::string> queue;
+    bool stopping;
+    std::thread writer;
+
+    void run() {
+        std::vector<std::string> batch;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wakeup.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty() && stopping) {
+                return;
+            }
+            batch.swap(queue);
+            lock.unlock();
+
+            std::string text;
+            for (const auto& line : batch) {
+                text += line;
+            }
+            fwrite(text.data(), 1, text.size(), stderr);
+            fflush(stderr);
+            batch.clear();
+
+            lock.lock();
+        }
+    }
+
+public:
+    Logger() : level(LogLevel::INFO), stopping(false) {
+        writer = std::thread(&Logger::run, this);
+    }
+
+    ~Logger() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeup.notify_one();
+        writer.join();
+    }
+
+    void setLevel(LogLevel minimum) {
+        level = minimum;
+    }
+
+    bool enabled(LogLevel messageLevel) const {
+        return messageLevel >= level;
+    }
+
+    void submit(std::string line) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(std::move(line));
+        }
+        wakeup.notify_one();
+    }
+};
+
+inline Logger logger;
+
+// One log line; collected with << and queued when it goes out of scope.
+class LogLine {
+private:
+    std::ostringstream text;
+
+public:
+    explicit LogLine(LogLevel level) {
+        static const char* NAMES[] = {"DEBUG", "INFO", "WARN", "ERROR"};
+        auto now = std::chrono::system_clock::now();
+        std::time_t seconds = std::chrono::system_clock::to_time_t(now);
+        int millis = int(std::chrono::duration_cast<std::chrono::milliseconds>(
+            now.time_since_epoch()).count() % 1000);
+        struct tm local;
+        localtime_r(&seconds, &local);
+        char stamp[32];
+        std::strftime(stamp, sizeof(stamp), "%H:%M:%S", &local);
+        char prefix[48];
+        std::snprintf(prefix, sizeof(prefix), "%s.%03d %-5s ", stamp, millis, NAMES[int(level)]);
+        text << prefix;
+    }
+
+    ~LogLine() {
+        text << '\n';
+        logger.submit(text.str());
+    }
+
+    template <typename T>
+    LogLine& operator<<(const T& value) {
+        text << value;
+        return *this;
+    }
+};
+
+#define LOG(level) if (!logger.enabled(LogLevel::level)) ; else LogLine(LogLevel::level)
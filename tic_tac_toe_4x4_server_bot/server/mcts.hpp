@@ -0,0 +1,283 @@
+#pragma once
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <thread>
+#include <vector>
+#include "engine.hpp"
+
+// Monte Carlo Tree Search (UCT, optionally with RAVE) over the engine's
+// bitboard rules, as an anytime alternative to the alpha-beta Engine.
+
+struct MctsOptions {
+    int threads = 1;                      // root parallel: one independent tree per thread
+    bool rave = false;
+    size_t poolSize = size_t(1) << 20;    // nodes preallocated per tree
+};
+
+struct MctsNode {
+    int32_t firstChild;   // -1 until expanded
+    uint8_t childCount;
+    int8_t move;
+    int8_t outcome;       // rule outcome of `move` for the player who made it
+    uint32_t visits;
+    uint32_t wins;        // for the player who made `move`, in half points: 2 a win, 1 a draw
+    uint32_t amafVisits;
+    uint32_t amafWins;
+};
+
+// One UCT tree over a fixed node pool. Children of a node are allocated as
+// one contiguous block when it is first selected; once the pool is full,
+// leaves are simply evaluated by playout.
+class MctsTree {
+private:
+    static constexpr float EXPLORATION = 0.7f;
+    static constexpr float RAVE_EQUIVALENCE = 300.0f;
+
+    std::vector<MctsNode> pool;
+    size_t used;
+    std::mt19937 rng;
+    bool rave;
+    Position root;
+    int rootSide;
+
+    // Who played each cell during the current iteration, and at which ply.
+    int8_t cellPlayer[NUM_CELLS];
+    int8_t cellPly[NUM_CELLS];
+
+    void expand(int node, const Position& position) {
+        Bitboard empty = ~position.occupied() & FULL_BOARD;
+        int count = __builtin_popcount(empty);
+        if (used + count > pool.size()) {
+            return;
+        }
+        int side = position.sideToMove();
+        pool[node].firstChild = used;
+        pool[node].childCount = count;
+        while (empty) {
+            int cell = __builtin_ctz(empty);
+            empty &= empty - 1;
+            int8_t outcome = lines.outcome(position.stones[side] | cellBit(cell), cell);
+            pool[used++] = MctsNode{-1, 0, int8_t(cell), outcome, 0, 0, 0, 0};
+        }
+    }
+
+    int select(int node) const {
+        const MctsNode& parent = pool[node];
+        float logVisits = std::log(float(parent.visits) + 1.0f);
+        int best = parent.firstChild;
+        float bestValue = -1.0f;
+        for (int i = 0; i < parent.childCount; i++) {
+            const MctsNode& child = pool[parent.firstChild + i];
+            float value;
+            if (child.outcome == 1) {
+                return parent.firstChild + i;
+            } else if (child.visits == 0 && (!rave || child.amafVisits == 0)) {
+                value = 1e9f;
+            } else {
+                float visits = float(child.visits);
+                float q = child.visits > 0 ? 0.5f * float(child.wins) / visits : 0.0f;
+                if (rave && child.amafVisits > 0) {
+                    float beta = std::sqrt(RAVE_EQUIVALENCE / (3.0f * visits + RAVE_EQUIVALENCE));
+                    q = (1.0f - beta) * q + beta * 0.5f * float(child.amafWins) / float(child.amafVisits);
+                }
+                value = q + EXPLORATION * std::sqrt(logVisits / (visits + 1.0f));
+            }
+            if (value > bestValue) {
+                bestValue = value;
+                best = parent.firstChild + i;
+            }
+        }
+        return best;
+    }
+
+    // Plays uniformly random moves to the end; returns the winner or -1 on a draw.
+    int playout(Position& position, int ply) {
+        int cells[NUM_CELLS];
+        int count = 0;
+        for (Bitboard empty = ~position.occupied() & FULL_BOARD; empty; empty &= empty - 1) {
+            cells[count++] = __builtin_ctz(empty);
+        }
+        int side = position.sideToMove();
+        for (int i = 0; i < count; i++) {
+            int pick = i + rng() % (count - i);
+            std::swap(cells[i], cells[pick]);
+            int cell = cells[i];
+            position.stones[side] |= cellBit(cell);
+            cellPlayer[cell] = side;
+            cellPly[cell] = ply++;
+            int outcome = lines.outcome(position.stones[side], cell);
+            if (outcome != 0) {
+                return outcome == 1 ? side : 1 - side;
+            }
+            side ^= 1;
+        }
+        return -1;
+    }
+
+public:
+    MctsTree(size_t capacity, unsigned seed, bool useRave)
+        : pool(capacity), used(0), rng(seed), rave(useRave), rootSide(0) {}
+
+    void reset(const Position& position) {
+        root = position;
+        rootSide = position.sideToMove();
+        pool[0] = MctsNode{-1, 0, -1, 0, 0, 0, 0, 0};
+        used = 1;
+    }
+
+    void iterate() {
+        Position position = root;
+        int path[NUM_CELLS + 1];
+        int depth = 0;
+        int node = 0;
+        int winner = -1;
+        bool finished = false;
+
+        for (int cell = 0; cell < NUM_CELLS; cell++) {
+            cellPlayer[cell] = -1;
+        }
+        path[depth++] = node;
+
+        while (true) {
+            if (pool[node].outcome != 0) {
+                int mover = 1 - position.sideToMove();
+                winner = pool[node].outcome == 1 ? mover : 1 - mover;
+                finished = true;
+                break;
+            }
+            if (position.isFull()) {
+                finished = true;
+                break;
+            }
+            if (pool[node].firstChild < 0) {
+                expand(node, position);
+                if (pool[node].firstChild < 0) {
+                    break;
+                }
+            }
+            node = select(node);
+            int cell = pool[node].move;
+            cellPlayer[cell] = position.sideToMove();
+            cellPly[cell] = depth - 1;
+            position.play(cell);
+            path[depth++] = node;
+            if (pool[node].visits == 0) {
+                if (pool[node].outcome != 0) {
+                    int mover = 1 - position.sideToMove();
+                    winner = pool[node].outcome == 1 ? mover : 1 - mover;
+                    finished = true;
+                }
+                break;
+            }
+        }
+
+        if (!finished) {
+            winner = playout(position, depth - 1);
+        }
+
+        for (int k = depth - 1; k >= 0; k--) {
+            MctsNode& current = pool[path[k]];
+            int mover = rootSide ^ ((k - 1) & 1);
+            current.visits++;
+            current.wins += winner < 0 ? 1 : (winner == mover ? 2 : 0);
+
+            if (rave && current.firstChild >= 0) {
+                int toMove = rootSide ^ (k & 1);
+                uint32_t result = winner < 0 ? 1 : (winner == toMove ? 2 : 0);
+                for (int i = 0; i < current.childCount; i++) {
+                    MctsNode& child = pool[current.firstChild + i];
+                    if (cellPlayer[child.move] == toMove && cellPly[child.move] >= k) {
+                        child.amafVisits++;
+                        child.amafWins += result;
+                    }
+                }
+            }
+        }
+    }
+
+    // Adds this tree's root statistics into per-cell totals.
+    void collect(uint64_t visits[NUM_CELLS], uint64_t wins[NUM_CELLS]) const {
+        const MctsNode& rootNode = pool[0];
+        for (int i = 0; i < rootNode.childCount; i++) {
+            const MctsNode& child = pool[rootNode.firstChild + i];
+            visits[child.move] += child.visits;
+            wins[child.move] += child.wins;
+        }
+    }
+};
+
+// Root-parallel UCT: each thread grows its own tree from the same position
+// and the most visited root move over all trees is played.
+class MctsEngine {
+private:
+    static constexpr uint64_t DEFAULT_PLAYOUTS = 20000;
+
+    MctsOptions options;
+    unsigned seed;
+    std::vector<MctsTree> trees;
+
+public:
+    MctsEngine(const MctsOptions& opts, unsigned rngSeed = std::random_device()())
+        : options(opts), seed(rngSeed) {}
+
+    // Runs limits.nodes playouts (over all threads), stopping early at
+    // limits.moveTimeMs or when limits.stop is set. The score is the expected
+    // result in percent for the side to move.
+    SearchResult search(const Position& position, const SearchLimits& limits) {
+        auto start = std::chrono::steady_clock::now();
+        auto deadline = start + std::chrono::milliseconds(limits.moveTimeMs);
+        uint64_t playouts = limits.nodes > 0 ? limits.nodes : DEFAULT_PLAYOUTS;
+        uint64_t perThread = std::max<uint64_t>(1, playouts / options.threads);
+
+        // Pools are allocated on first use and reused for every later search.
+        while (int(trees.size()) < options.threads) {
+            trees.emplace_back(options.poolSize, seed + trees.size(), options.rave);
+        }
+
+        std::vector<uint64_t> done(options.threads, 0);
+        auto worker = [&](int t) {
+            trees[t].reset(position);
+            for (uint64_t i = 0; i < perThread; i++) {
+                if ((i & 63) == 0 && i > 0) {
+                    if (limits.moveTimeMs > 0 && std::chrono::steady_clock::now() >= deadline) break;
+                    if (limits.stop && limits.stop->load(std::memory_order_relaxed)) break;
+                }
+                trees[t].iterate();
+                done[t]++;
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (int t = 1; t < options.threads; t++) {
+            threads.emplace_back(worker, t);
+        }
+        worker(0);
+        for (auto& t : threads) {
+            t.join();
+        }
+
+        uint64_t visits[NUM_CELLS] = {};
+        uint64_t wins[NUM_CELLS] = {};
+        for (const auto& tree : trees) {
+            tree.collect(visits, wins);
+        }
+
+        SearchResult result;
+        for (int cell = 0; cell < NUM_CELLS; cell++) {
+            if (visits[cell] > 0 && (result.move < 0 || visits[cell] > visits[result.move])) {
+                result.move = cell;
+            }
+        }
+        if (result.move >= 0) {
+            result.score = int(50.0 * double(wins[result.move]) / double(visits[result.move]));
+            result.pv.push_back(result.move);
+        }
+        for (uint64_t n : done) {
+            result.stats.nodes += n;
+        }
+        result.stats.micros = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        return result;
+    }
+};
@@ -0,0 +1,155 @@
+#pragma once
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "latency_histogram.hpp"
+
+// Counters and histograms of one server worker. Each is written only by its
+// worker's loop and read by the metrics thread, so counters are relaxed
+// atomics (a plain increment, no lock prefix) and the histogram has a lock
+// that is only contended while a scrape copies it.
+struct WorkerMetrics {
+    std::atomic<uint64_t> connectionsAccepted{0};
+    std::atomic<uint64_t> connectionsOpen{0};
+    std::atomic<uint64_t> gamesStarted{0};
+    std::atomic<uint64_t> gamesCompleted{0};
+    std::atomic<uint64_t> gamesActive{0};
+    std::atomic<uint64_t> moves{0};
+    std::atomic<uint64_t> protocolErrors{0};
+    std::atomic<uint64_t> disconnects{0};
+    std::atomic<uint64_t> timeForfeits{0};
+
+    std::mutex histogramMutex;
+    LatencyHistogram thinkTime;  // prompt sent until the move arrived, microseconds
+
+    static void add(std::atomic<uint64_t>& counter, int64_t delta = 1) {
+        counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+
+    void recordThinkTime(uint64_t micros) {
+        std::lock_guard<std::mutex> lock(histogramMutex);
+        thinkTime.record(micros);
+    }
+};
+
+// Serves the sum of all workers' metrics as plain text, one "name value"
+// line each, on a local TCP port from its own thread. Any request (or none)
+// gets the current values; an HTTP GET gets them with an HTTP header.
+class MetricsServer {
+private:
+    std::vector<WorkerMetrics*> workers;
+    int listenSocket;
+    std::thread thread;
+    std::chrono::steady_clock::time_point startTime;
+    std::chrono::steady_clock::time_point lastScrape;
+    uint64_t lastMoves;
+
+    std::string render() {
+        uint64_t totals[9] = {};
+        LatencyHistogram thinkTime;
+        for (WorkerMetrics* worker : workers) {
+            const std::atomic<uint64_t>* counters[9] = {
+                &worker->connectionsAccepted, &worker->connectionsOpen, &worker->gamesStarted,
+                &worker->gamesCompleted, &worker->gamesActive, &worker->moves,
+                &worker->protocolErrors, &worker->disconnects, &worker->timeForfeits
+            };
+            for (int i = 0; i < 9; i++) {
+                totals[i] += counters[i]->load(std::memory_order_relaxed);
+            }
+            std::lock_guard<std::mutex> lock(worker->histogramMutex);
+            thinkTime.merge(worker->thinkTime);
+        }
+
+        // Moves per second since the previous scrape
+        auto now = std::chrono::steady_clock::now();
+        double interval = std::chrono::duration<double>(now - lastScrape).count();
+        double movesPerSecond = interval > 0 ? (totals[5] - lastMoves) / interval : 0.0;
+        lastScrape = now;
+        lastMoves = totals[5];
+
+        std::ostringstream text;
+        text << "uptime_seconds " << std::chrono::duration_cast<std::chrono::seconds>(now - startTime).count() << "\n"
+             << "workers " << workers.size() << "\n"
+             << "connections_accepted_total " << totals[0] << "\n"
+             << "connections_open " << totals[1] << "\n"
+             << "games_started_total " << totals[2] << "\n"
+             << "games_completed_total " << totals[3] << "\n"
+             << "games_active " << totals[4] << "\n"
+             << "moves_total " << totals[5] << "\n"
+             << "moves_per_second " << uint64_t(movesPerSecond) << "\n"
+             << "protocol_errors_total " << totals[6] << "\n"
+             << "disconnects_total " << totals[7] << "\n"
+             << "time_forfeits_total " << totals[8] << "\n"
+             << "think_time_us_count " << thinkTime.count() << "\n"
+             << "think_time_us_mean " << uint64_t(thinkTime.mean()) << "\n";
+        for (double quantile : {0.5, 0.9, 0.99, 0.999}) {
+            text << "think_time_us{quantile=\"" << quantile << "\"} " << thinkTime.percentile(quantile) << "\n";
+        }
+        text << "think_time_us_max " << thinkTime.max() << "\n";
+        return text.str();
+    }
+
+    void serve() {
+        while (true) {
+            int client = accept(listenSocket, nullptr, nullptr);
+            if (client < 0) {
+                if (errno == EINTR) continue;
+                return;  // listening socket closed
+            }
+
+            // Read whatever request arrives within a moment
+            struct timeval timeout = {0, 100000};
+            setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            char request[512];
+            ssize_t length = recv(client, request, sizeof(request), 0);
+
+            std::string body = render();
+            std::string response = body;
+            if (length >= 3 && std::memcmp(request, "GET", 3) == 0) {
+                response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain\r\nContent-Length: " +
+                           std::to_string(body.size()) + "\r\n\r\n" + body;
+            }
+            send(client, response.data(), response.size(), MSG_NOSIGNAL);
+            close(client);
+        }
+    }
+
+public:
+    MetricsServer(int port, const std::vector<WorkerMetrics*>& workerMetrics)
+        : workers(workerMetrics), startTime(std::chrono::steady_clock::now()),
+          lastScrape(startTime), lastMoves(0) {
+        listenSocket = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listenSocket < 0) {
+            throw std::runtime_error("Failed to create metrics socket");
+        }
+        int opt = 1;
+        setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+        // Local only
+        struct sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(port);
+        if (bind(listenSocket, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(listenSocket, 16) < 0) {
+            close(listenSocket);
+            throw std::runtime_error("Failed to bind metrics port");
+        }
+        thread = std::thread(&MetricsServer::serve, this);
+    }
+
+    ~MetricsServer() {
+        shutdown(listenSocket, SHUT_RDWR);
+        close(listenSocket);
+        thread.join();
+    }
+};
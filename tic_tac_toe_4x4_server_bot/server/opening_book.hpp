@@ -0,0 +1,147 @@
+#pragma once
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+#include "engine.hpp"
+
+// One book position: the moves that tie for best, as a cell mask in canonical
+// coordinates, and their score for the side to move.
+struct BookEntry {
+    uint64_t key;
+    uint32_t moves;
+    int32_t score;
+};
+
+// Sorted array of entries, stored on disk as a small header followed by the
+// raw 16-byte records.
+class OpeningBook {
+private:
+    static const uint32_t MAGIC = 0x4b423554;  // "T5BK"
+    static const uint32_t VERSION = 1;
+    std::vector<BookEntry> entries;
+
+    void sortEntries() {
+        std::sort(entries.begin(), entries.end(),
+                  [](const BookEntry& a, const BookEntry& b) { return a.key < b.key; });
+    }
+
+public:
+    size_t size() const {
+        return entries.size();
+    }
+
+    void add(const BookEntry& entry) {
+        entries.push_back(entry);
+    }
+
+    const BookEntry* find(uint64_t key) const {
+        auto it = std::lower_bound(entries.begin(), entries.end(), key,
+                                   [](const BookEntry& entry, uint64_t k) { return entry.key < k; });
+        if (it != entries.end() && it->key == key) {
+            return &*it;
+        }
+        return nullptr;
+    }
+
+    // A random one of the best moves for `position`, mapped back from
+    // canonical coordinates, or -1 when the position is out of book.
+    int pickMove(const Position& position, std::mt19937& rng, int* score = nullptr) const {
+        CanonicalPosition canon = position.canonical();
+        const BookEntry* entry = find(canon.key);
+        if (!entry) {
+            return -1;
+        }
+
+        std::vector<int> candidates;
+        for (int cell = 0; cell < NUM_CELLS; cell++) {
+            if (entry->moves & cellBit(cell)) {
+                int actual = symmetries.cellImage[symmetries.inverse[canon.sym]][cell];
+                if (position.isEmpty(actual)) {
+                    candidates.push_back(actual);
+                }
+            }
+        }
+        if (candidates.empty()) {
+            return -1;
+        }
+
+        if (score) {
+            *score = entry->score;
+        }
+        std::uniform_int_distribution<size_t> dist(0, candidates.size() - 1);
+        return candidates[dist(rng)];
+    }
+
+    bool load(const std::string& path) {
+        std::ifstream in(path, std::ios::binary);
+        uint32_t header[3];
+        if (!in.read(reinterpret_cast<char*>(header), sizeof(header)) ||
+            header[0] != MAGIC || header[1] != VERSION) {
+            return false;
+        }
+        std::vector<BookEntry> loaded(header[2]);
+        if (!in.read(reinterpret_cast<char*>(loaded.data()), loaded.size() * sizeof(BookEntry))) {
+            return false;
+        }
+        entries.swap(loaded);
+        sortEntries();
+        return true;
+    }
+
+    bool save(const std::string& path) {
+        sortEntries();
+        std::ofstream out(path, std::ios::binary);
+        uint32_t header[3] = {MAGIC, VERSION, uint32_t(entries.size())};
+        out.write(reinterpret_cast<const char*>(header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(BookEntry));
+        return bool(out);
+    }
+
+    // Searches every canonical position in the first `plies` plies to `depth`
+    // and records the set of best moves for the side to move. `progress` is
+    // called after each ply with the number of positions so far. One table
+    // serves both sides: its scores are for the side to move and its keys
+    // hold both sides' stones, which fix whose move it is.
+    static OpeningBook build(Engine& engine, int plies, int depth,
+                             const std::function<void(int, size_t)>& progress = nullptr) {
+        OpeningBook book;
+        std::vector<Position> frontier(1);
+        std::set<uint64_t> seen;
+
+        for (int ply = 0; ply < plies; ply++) {
+            std::vector<Position> next;
+            for (const Position& position : frontier) {
+                CanonicalPosition canon = position.canonical();
+                if (!seen.insert(canon.key).second) continue;
+
+                std::vector<ScoredMove> ranked = engine.rankMoves(position, depth);
+                BookEntry entry = {canon.key, 0, -INF - 1};
+                for (const auto& move : ranked) {
+                    entry.score = std::max(entry.score, move.score);
+                }
+                for (const auto& move : ranked) {
+                    if (move.score == entry.score) {
+                        entry.moves |= cellBit(symmetries.cellImage[canon.sym][move.cell]);
+                    }
+                    Position child = position;
+                    child.play(move.cell);
+                    if (child.outcome(move.cell) == 0) {
+                        next.push_back(child);
+                    }
+                }
+                book.add(entry);
+            }
+            if (progress) {
+                progress(ply, book.size());
+            }
+            frontier.swap(next);
+        }
+
+        book.sortEntries();
+        return book;
+    }
+};
@@ -0,0 +1,162 @@
+#pragma once
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+// Message framing shared by the server and the clients.
+//
+// Every message is sent as one line ending in '\n'. Peers built before
+// framing send bare messages with one write per message, so until a
+// connection has sent its first '\n' the reader also accepts:
+// - fixed-length messages (3-digit server codes, 2-digit moves), or
+// - with no fixed length, whatever one read returned (the hello line).
+
+// Incoming bytes of one connection in a fixed ring buffer, cut into
+// messages. Messages are returned as views into the ring; only one that
+// wraps around the end is copied, into a scratch buffer.
+class FrameReader {
+public:
+    static constexpr uint32_t CAPACITY = 256;  // power of two, well above the longest message
+
+private:
+    char data[CAPACITY];
+    char scratch[CAPACITY];
+    uint32_t head;      // read position, free-running
+    uint32_t tail;      // write position, free-running
+    uint32_t consumed;  // length of the last message, released on the next call
+    size_t legacyLength;
+    bool framed;
+
+    static uint32_t index(uint32_t position) {
+        return position & (CAPACITY - 1);
+    }
+
+    std::string_view view(uint32_t length) {
+        uint32_t start = index(head);
+        if (start + length <= CAPACITY) {
+            return std::string_view(data + start, length);
+        }
+        uint32_t first = CAPACITY - start;
+        std::memcpy(scratch, data + start, first);
+        std::memcpy(scratch + first, data, length - first);
+        return std::string_view(scratch, length);
+    }
+
+public:
+    explicit FrameReader(size_t legacy = 0)
+        : head(0), tail(0), consumed(0), legacyLength(legacy), framed(false) {}
+
+    // Length of a bare message from a peer that does not frame; 0 takes
+    // everything received so far as one message.
+    void setLegacyLength(size_t length) {
+        legacyLength = length;
+    }
+
+    uint32_t size() const {
+        return tail - head;
+    }
+
+    bool full() const {
+        return size() == CAPACITY;
+    }
+
+    // Reads whatever the socket has into the free space of the ring with a
+    // single readv. Returns the byte count, 0 on end of stream, or -1 with
+    // errno set (EAGAIN on a non-blocking socket with nothing to read).
+    ssize_t fill(int fd) {
+        head += consumed;
+        consumed = 0;
+
+        uint32_t space = CAPACITY - size();
+        if (space == 0) {
+            errno = ENOBUFS;
+            return -1;
+        }
+        uint32_t start = index(tail);
+        uint32_t first = std::min(space, CAPACITY - start);
+        struct iovec spans[2] = {
+            {data + start, first},
+            {data, space - first}
+        };
+        ssize_t received = readv(fd, spans, space > first ? 2 : 1);
+        if (received > 0) {
+            tail += uint32_t(received);
+        }
+        return received;
+    }
+
+    // The next complete message, without its line ending. The view stays
+    // valid until the next call to next() or fill().
+    bool next(std::string_view& message) {
+        head += consumed;
+        consumed = 0;
+
+        while (size() > 0) {
+            uint32_t length = 0;
+            while (length < size() && data[index(head + length)] != '\n') {
+                length++;
+            }
+
+            if (length < size()) {
+                framed = true;
+                if (length == 0) {  // blank line, or the end of a legacy message
+                    head++;
+                    continue;
+                }
+                message = view(length);
+                if (message.back() == '\r') {
+                    message.remove_suffix(1);
+                }
+                consumed = length + 1;
+                return true;
+            }
+
+            if (framed || (legacyLength > 0 && size() < legacyLength)) {
+                return false;
+            }
+            uint32_t bare = legacyLength > 0 ? uint32_t(legacyLength) : size();
+            message = view(bare);
+            consumed = bare;
+            return true;
+        }
+        return false;
+    }
+
+    // Blocks until the next message has arrived on `fd`. Returns false when
+    // the connection closes or fails.
+    bool receive(int fd, std::string_view& message) {
+        while (!next(message)) {
+            ssize_t received = fill(fd);
+            if (received < 0 && errno == EINTR) continue;
+            if (received <= 0) return false;
+        }
+        return true;
+    }
+};
+
+// Appends one framed message to an output buffer.
+inline void appendFrame(std::string& output, std::string_view message) {
+    output.append(message.data(), message.size());
+    output.push_back('\n');
+}
+
+// Sends one framed message on a blocking socket.
+inline bool sendFrame(int fd, std::string_view message) {
+    std::string frame;
+    appendFrame(frame, message);
+    size_t offset = 0;
+    while (offset < frame.size()) {
+        ssize_t sent = send(fd, frame.data() + offset, frame.size() - offset, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        offset += size_t(sent);
+    }
+    return true;
+}
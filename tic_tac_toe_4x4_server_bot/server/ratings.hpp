@@ -0,0 +1,83 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// One player's Elo rating and results.
+struct PlayerStats {
+    double rating;
+    uint32_t wins;
+    uint32_t draws;
+    uint32_t losses;
+};
+
+// Elo ratings by player name, shared by all server workers. It is read when
+// a player joins the lobby and written once per finished game, so a single
+// lock is enough.
+class RatingTable {
+public:
+    static constexpr double INITIAL_RATING = 1500.0;
+
+private:
+    static constexpr double K_FACTOR = 32.0;
+
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, PlayerStats> players;
+
+    PlayerStats& entry(const std::string& name) {
+        return players.emplace(name, PlayerStats{INITIAL_RATING, 0, 0, 0}).first->second;
+    }
+
+public:
+    double rating(const std::string& name) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = players.find(name);
+        return it != players.end() ? it->second.rating : INITIAL_RATING;
+    }
+
+    // `score` is the result for `first`: 1 win, 0.5 draw, 0 loss.
+    void recordGame(const std::string& first, const std::string& second, double score) {
+        std::lock_guard<std::mutex> lock(mutex);
+        PlayerStats& a = entry(first);
+        PlayerStats& b = entry(second);
+        double expected = 1.0 / (1.0 + std::pow(10.0, (b.rating - a.rating) / 400.0));
+        double delta = K_FACTOR * (score - expected);
+        a.rating += delta;
+        b.rating -= delta;
+        if (score > 0.5) {
+            a.wins++;
+            b.losses++;
+        } else if (score < 0.5) {
+            a.losses++;
+            b.wins++;
+        } else {
+            a.draws++;
+            b.draws++;
+        }
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return players.size();
+    }
+
+    // Copy of every player, for snapshots.
+    std::vector<std::pair<std::string, PlayerStats>> all() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return std::vector<std::pair<std::string, PlayerStats>>(players.begin(), players.end());
+    }
+
+    // Replaces the table, when recovering from a snapshot.
+    void restore(std::vector<std::pair<std::string, PlayerStats>> saved) {
+        std::lock_guard<std::mutex> lock(mutex);
+        players.clear();
+        players.reserve(saved.size());
+        for (auto& player : saved) {
+            players.emplace(std::move(player.first), player.second);
+        }
+    }
+};
@@ -0,0 +1,338 @@
+#pragma once
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "logger.hpp"
+#include "ratings.hpp"
+
+// Durable game results for a RatingTable. Every result goes to the table at
+// once and to an append-only log, which a background thread writes in
+// groups: one write() and one fdatasync() per commit interval, however many
+// games ended in it. After enough records the thread writes the whole table
+// as a snapshot and starts a new, empty log, so recovery reads one snapshot
+// and replays at most one short log.
+//
+// Files, for a store at PATH:
+//     PATH.snapshot     table after generation N's log; written to a temp file and renamed
+//     PATH.N.log        results since that snapshot
+//
+// Log record: score for the first player in halves (0, 1, 2), both name
+// lengths, both names, then a 32-bit FNV-1a checksum of those bytes. A torn
+// or corrupt tail is cut off on recovery.
+class ResultStore {
+private:
+    static constexpr uint32_t SNAPSHOT_MAGIC = 0x53523554;  // "T5RS"
+    static constexpr uint32_t LOG_MAGIC = 0x4c523554;       // "T5RL"
+    static constexpr uint32_t VERSION = 1;
+    static const int COMMIT_MS = 100;                       // longest a result waits to be durable
+    static const size_t SNAPSHOT_RECORDS = 100000;          // log records between snapshots
+
+    RatingTable& ratings;
+    std::string path;
+    uint64_t generation;
+    int logFd;
+    size_t loggedRecords;                                   // in the current log
+
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::string pending;                                    // encoded records not yet written
+    size_t pendingRecords;
+    bool stopping;
+    std::thread writer;
+
+    static uint32_t checksum(const char* data, size_t size) {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ uint8_t(data[i])) * 16777619u;
+        }
+        return hash;
+    }
+
+    template <typename T>
+    static void put(std::string& out, T value) {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    template <typename T>
+    static bool get(const std::string& in, size_t& offset, T& value) {
+        if (in.size() - offset < sizeof(value)) return false;
+        std::memcpy(&value, in.data() + offset, sizeof(value));
+        offset += sizeof(value);
+        return true;
+    }
+
+    std::string logPath(uint64_t logGeneration) const {
+        return path + "." + std::to_string(logGeneration) + ".log";
+    }
+
+    static bool readFile(const std::string& file, std::string& contents) {
+        int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            if (errno == ENOENT) return false;
+            throw std::runtime_error("Cannot open " + file + ": " + std::strerror(errno));
+        }
+        struct stat info;
+        fstat(fd, &info);
+        contents.resize(size_t(info.st_size));
+        size_t done = 0;
+        while (done < contents.size()) {
+            ssize_t got = read(fd, &contents[done], contents.size() - done);
+            if (got < 0 && errno == EINTR) continue;
+            if (got <= 0) break;
+            done += size_t(got);
+        }
+        contents.resize(done);
+        close(fd);
+        return true;
+    }
+
+    static void writeAll(int fd, const std::string& data, const std::string& file) {
+        size_t done = 0;
+        while (done < data.size()) {
+            ssize_t written = write(fd, data.data() + done, data.size() - done);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                throw std::runtime_error("Cannot write " + file + ": " + std::strerror(errno));
+            }
+            done += size_t(written);
+        }
+    }
+
+    static void encode(std::string& out, const std::string& first, const std::string& second, double score) {
+        size_t start = out.size();
+        uint8_t firstLength = uint8_t(std::min<size_t>(first.size(), 255));
+        uint8_t secondLength = uint8_t(std::min<size_t>(second.size(), 255));
+        put(out, uint8_t(score * 2 + 0.5));
+        put(out, firstLength);
+        put(out, secondLength);
+        out.append(first, 0, firstLength);
+        out.append(second, 0, secondLength);
+        put(out, checksum(out.data() + start, out.size() - start));
+    }
+
+    // Loads PATH.snapshot into the table; returns false if there is none.
+    bool loadSnapshot() {
+        std::string data;
+        if (!readFile(path + ".snapshot", data)) return false;
+
+        // Snapshots are renamed into place complete, so any damage is an error
+        uint32_t stored = 0;
+        size_t end = data.size() - std::min(data.size(), sizeof(stored));
+        get(data, end, stored);
+        if (data.size() < 24 + sizeof(stored) || stored != checksum(data.data(), data.size() - sizeof(stored))) {
+            throw std::runtime_error("Corrupt result snapshot " + path + ".snapshot");
+        }
+        size_t offset = 0;
+        uint32_t magic, version;
+        uint64_t count;
+        get(data, offset, magic);
+        get(data, offset, version);
+        get(data, offset, generation);
+        get(data, offset, count);
+        if (magic != SNAPSHOT_MAGIC || version != VERSION) {
+            throw std::runtime_error("Not a result snapshot: " + path + ".snapshot");
+        }
+
+        std::vector<std::pair<std::string, PlayerStats>> players;
+        players.reserve(size_t(count));
+        for (uint64_t i = 0; i < count; i++) {
+            uint8_t length;
+            PlayerStats stats;
+            if (!get(data, offset, length) || data.size() - offset < length) break;
+            std::string name(data, offset, length);
+            offset += length;
+            if (!get(data, offset, stats.rating) || !get(data, offset, stats.wins) ||
+                !get(data, offset, stats.draws) || !get(data, offset, stats.losses)) break;
+            players.emplace_back(std::move(name), stats);
+        }
+        ratings.restore(std::move(players));
+        return true;
+    }
+
+    // Replays the current log, cutting off a torn tail, and leaves it open
+    // for appending.
+    void openLog() {
+        std::string file = logPath(generation);
+        std::string data;
+        size_t good = 0;
+        if (readFile(file, data) && data.size() >= 16) {
+            size_t offset = 0;
+            uint32_t magic, version;
+            uint64_t logGeneration;
+            get(data, offset, magic);
+            get(data, offset, version);
+            get(data, offset, logGeneration);
+            if (magic != LOG_MAGIC || version != VERSION || logGeneration != generation) {
+                throw std::runtime_error("Not a result log: " + file);
+            }
+            good = offset;
+            while (true) {
+                uint8_t score, firstLength, secondLength;
+                uint32_t stored;
+                size_t start = offset;
+                if (!get(data, offset, score) || !get(data, offset, firstLength) ||
+                    !get(data, offset, secondLength) || data.size() - offset < size_t(firstLength) + secondLength) {
+                    break;
+                }
+                std::string first(data, offset, firstLength);
+                std::string second(data, offset + firstLength, secondLength);
+                offset += size_t(firstLength) + secondLength;
+                if (!get(data, offset, stored) || stored != checksum(data.data() + start, offset - start - 4) ||
+                    score > 2) {
+                    break;
+                }
+                ratings.recordGame(first, second, score / 2.0);
+                loggedRecords++;
+                good = offset;
+            }
+        }
+
+        logFd = open(file.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        if (logFd < 0) {
+            throw std::runtime_error("Cannot open result log " + file + ": " + std::strerror(errno));
+        }
+        if (good == 0) {
+            std::string header;
+            put(header, LOG_MAGIC);
+            put(header, VERSION);
+            put(header, generation);
+            if (ftruncate(logFd, 0) < 0) {
+                throw std::runtime_error("Cannot truncate result log " + file);
+            }
+            writeAll(logFd, header, file);
+            good = header.size();
+        } else if (good < data.size()) {
+            LOG(WARN) << "Result log " << file << ": dropped " << data.size() - good << " bytes of torn tail";
+            if (ftruncate(logFd, off_t(good)) < 0) {
+                throw std::runtime_error("Cannot truncate result log " + file);
+            }
+        }
+        lseek(logFd, off_t(good), SEEK_SET);
+    }
+
+    // Writes the table as generation + 1 and switches to a new, empty log.
+    void snapshot(const std::vector<std::pair<std::string, PlayerStats>>& players) {
+        std::string data;
+        put(data, SNAPSHOT_MAGIC);
+        put(data, VERSION);
+        put(data, generation + 1);
+        put(data, uint64_t(players.size()));
+        for (const auto& player : players) {
+            uint8_t length = uint8_t(std::min<size_t>(player.first.size(), 255));
+            put(data, length);
+            data.append(player.first, 0, length);
+            put(data, player.second.rating);
+            put(data, player.second.wins);
+            put(data, player.second.draws);
+            put(data, player.second.losses);
+        }
+        put(data, checksum(data.data(), data.size()));
+
+        std::string temp = path + ".snapshot.tmp";
+        int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot create " + temp + ": " + std::strerror(errno));
+        }
+        writeAll(fd, data, temp);
+        fsync(fd);
+        close(fd);
+        if (std::rename(temp.c_str(), (path + ".snapshot").c_str()) != 0) {
+            throw std::runtime_error("Cannot replace result snapshot: " + std::string(std::strerror(errno)));
+        }
+
+        // The old log is covered by the snapshot from here on
+        close(logFd);
+        std::string oldLog = logPath(generation);
+        generation++;
+        loggedRecords = 0;
+        openLog();
+        unlink(oldLog.c_str());
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wakeup.wait_for(lock, std::chrono::milliseconds(COMMIT_MS), [this] { return stopping; });
+            std::string batch;
+            batch.swap(pending);
+            size_t batchRecords = pendingRecords;
+            pendingRecords = 0;
+            size_t unsnapshotted = loggedRecords + batchRecords;
+            bool due = unsnapshotted >= SNAPSHOT_RECORDS || (stopping && unsnapshotted > 0);
+            // The copy is taken with the batch, so it holds exactly the logged results
+            std::vector<std::pair<std::string, PlayerStats>> players;
+            if (due) players = ratings.all();
+            bool last = stopping;
+            lock.unlock();
+
+            try {
+                if (!batch.empty()) {
+                    writeAll(logFd, batch, logPath(generation));
+                    fdatasync(logFd);
+                    loggedRecords += batchRecords;
+                }
+                if (due) {
+                    snapshot(players);
+                }
+            } catch (const std::exception& e) {
+                LOG(ERROR) << "Result store: " << e.what();
+            }
+
+            if (last) return;
+            lock.lock();
+        }
+    }
+
+public:
+    // Recovers `table` from the store at `basePath`, creating it if needed.
+    ResultStore(RatingTable& table, const std::string& basePath)
+        : ratings(table), path(basePath), generation(0), logFd(-1), loggedRecords(0),
+          pendingRecords(0), stopping(false) {
+        auto start = std::chrono::steady_clock::now();
+        if (loadSnapshot() && generation > 0) {
+            unlink(logPath(generation - 1).c_str());  // left over if the last snapshot was cut short
+        }
+        openLog();
+        LOG(INFO) << "Results: " << ratings.size() << " players from " << path << " (" << loggedRecords
+                  << " log records replayed) in "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(
+                         std::chrono::steady_clock::now() - start).count() << " ms";
+        writer = std::thread(&ResultStore::run, this);
+    }
+
+    // Commits what is pending and writes a final snapshot.
+    ~ResultStore() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeup.notify_one();
+        writer.join();
+        close(logFd);
+    }
+
+    ResultStore(const ResultStore&) = delete;
+    ResultStore& operator=(const ResultStore&) = delete;
+
+    // Applies a result to the ratings and queues it for the log. `score` is
+    // the result for `first`: 1 win, 0.5 draw, 0 loss.
+    void record(const std::string& first, const std::string& second, double score) {
+        std::lock_guard<std::mutex> lock(mutex);
+        ratings.recordGame(first, second, score);  // under the store lock: log order is apply order
+        encode(pending, first, second, score);
+        pendingRecords++;
+    }
+};
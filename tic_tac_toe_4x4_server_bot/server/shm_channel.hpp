@@ -0,0 +1,300 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include "handover.hpp"
+#include "protocol.hpp"
+
+// Shared-memory message channel between the server and a client on the same
+// host. A client on a Unix socket sends 900 right after the welcome; the
+// server answers 901 with three descriptors (SCM_RIGHTS): a memory segment
+// holding one single-producer/single-consumer ring per direction, and one
+// eventfd doorbell per side. Every later message, the hello included, goes
+// through the rings; the socket only tells either side when the other one
+// has gone.
+//
+// A reader that is polling its ring sees a message as soon as the cache
+// line with the ring's tail moves over. Before a reader blocks it sets the
+// ring's sleeping flag, and a writer that finds the flag set rings the
+// reader's doorbell, so a wakeup costs a system call only when the reader
+// was idle.
+
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+// One direction. Each message is a 16-bit length and its bytes; positions
+// are free-running and wrap at the capacity.
+struct ShmRing {
+    static constexpr uint32_t CAPACITY = 4096;  // power of two; a game uses a few hundred bytes
+
+    alignas(64) std::atomic<uint32_t> tail;     // written by the producer
+    alignas(64) std::atomic<uint32_t> head;     // written by the consumer
+    std::atomic<uint32_t> sleeping;             // the consumer waits on its doorbell
+    alignas(64) char data[CAPACITY];
+
+    static_assert(std::atomic<uint32_t>::is_always_lock_free, "rings are shared between processes");
+};
+
+struct ShmSegment {
+    ShmRing toServer;
+    ShmRing toClient;
+};
+
+class ShmChannel {
+public:
+    enum Side { SERVER, CLIENT };
+
+    static constexpr const char* REQUEST = "900";
+    static constexpr const char* GRANT = "901";
+    static const int SPIN_MICROS = 50;          // how long a reader polls before it sleeps
+
+    // Polling only pays when the peer runs on another CPU; with one CPU a
+    // reader sleeps at once.
+    static std::chrono::microseconds spinTime() {
+        static const bool spin = std::thread::hardware_concurrency() > 1;
+        return std::chrono::microseconds(spin ? SPIN_MICROS : 0);
+    }
+
+private:
+    int memoryFd;
+    int serverDoorbell;
+    int clientDoorbell;
+    ShmSegment* segment;
+    ShmRing* in;
+    ShmRing* out;
+    int inDoorbell;                             // rung by the peer for this side
+    int outDoorbell;
+    bool corrupt;
+    char message[ShmRing::CAPACITY];            // the last message received
+
+    static void copyIn(ShmRing* ring, uint32_t position, const void* from, size_t size) {
+        uint32_t offset = position & (ShmRing::CAPACITY - 1);
+        size_t first = std::min<size_t>(size, ShmRing::CAPACITY - offset);
+        std::memcpy(ring->data + offset, from, first);
+        std::memcpy(ring->data, static_cast<const char*>(from) + first, size - first);
+    }
+
+    static void copyOut(const ShmRing* ring, uint32_t position, void* to, size_t size) {
+        uint32_t offset = position & (ShmRing::CAPACITY - 1);
+        size_t first = std::min<size_t>(size, ShmRing::CAPACITY - offset);
+        std::memcpy(to, ring->data + offset, first);
+        std::memcpy(static_cast<char*>(to) + first, ring->data, size - first);
+    }
+
+public:
+    // Maps a segment; takes ownership of the three descriptors.
+    ShmChannel(Side side, int memory, int serverBell, int clientBell)
+        : memoryFd(memory), serverDoorbell(serverBell), clientDoorbell(clientBell), corrupt(false) {
+        void* mapped = mmap(nullptr, sizeof(ShmSegment), PROT_READ | PROT_WRITE, MAP_SHARED, memoryFd, 0);
+        if (mapped == MAP_FAILED) {
+            close(memoryFd);
+            close(serverDoorbell);
+            close(clientDoorbell);
+            throw std::runtime_error("Cannot map shared-memory channel: " + std::string(std::strerror(errno)));
+        }
+        segment = static_cast<ShmSegment*>(mapped);
+        in = side == SERVER ? &segment->toServer : &segment->toClient;
+        out = side == SERVER ? &segment->toClient : &segment->toServer;
+        inDoorbell = side == SERVER ? serverDoorbell : clientDoorbell;
+        outDoorbell = side == SERVER ? clientDoorbell : serverDoorbell;
+    }
+
+    ~ShmChannel() {
+        munmap(segment, sizeof(ShmSegment));
+        close(memoryFd);
+        close(serverDoorbell);
+        close(clientDoorbell);
+    }
+
+    ShmChannel(const ShmChannel&) = delete;
+    ShmChannel& operator=(const ShmChannel&) = delete;
+
+    // A new, empty segment for the server side of a connection.
+    static std::shared_ptr<ShmChannel> create() {
+        int memory = memfd_create("game_channel", MFD_CLOEXEC);
+        if (memory < 0 || ftruncate(memory, sizeof(ShmSegment)) < 0) {
+            if (memory >= 0) close(memory);
+            throw std::runtime_error("Cannot create shared-memory channel: " + std::string(std::strerror(errno)));
+        }
+        int serverBell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        int clientBell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (serverBell < 0 || clientBell < 0) {
+            close(memory);
+            if (serverBell >= 0) close(serverBell);
+            if (clientBell >= 0) close(clientBell);
+            throw std::runtime_error("Cannot create channel doorbells");
+        }
+        return std::make_shared<ShmChannel>(SERVER, memory, serverBell, clientBell);
+    }
+
+    // The segment and both doorbells, to pass to the client or to another
+    // server process.
+    std::vector<int> descriptors() const {
+        return {memoryFd, serverDoorbell, clientDoorbell};
+    }
+
+    // Server side: answers a request on `socket` with the channel.
+    bool grant(int socket) const {
+        return sendHandover(socket, std::string(GRANT) + "\n", descriptors());
+    }
+
+    // Client side: reads the server's answer to a request. Returns null
+    // with errno set if it has not arrived (EAGAIN) or the connection failed,
+    // and null with errno EPROTO if the answer is not a grant.
+    static std::unique_ptr<ShmChannel> receiveGrant(int socket) {
+        std::string answer;
+        std::vector<int> fds;
+        errno = 0;
+        if (!receiveHandover(socket, answer, fds)) {
+            if (errno == 0) errno = ECONNRESET;  // end of stream
+            return nullptr;
+        }
+        if (answer != std::string(GRANT) + "\n" || fds.size() != 3) {
+            for (int fd : fds) close(fd);
+            errno = EPROTO;
+            return nullptr;
+        }
+        return std::unique_ptr<ShmChannel>(new ShmChannel(CLIENT, fds[0], fds[1], fds[2]));
+    }
+
+    // Client side, blocking: asks for a channel and waits for it.
+    static std::unique_ptr<ShmChannel> request(int socket) {
+        if (!sendFrame(socket, REQUEST)) {
+            throw std::runtime_error("Failed to request a shared-memory channel");
+        }
+        std::unique_ptr<ShmChannel> channel;
+        do {
+            channel = receiveGrant(socket);
+        } while (!channel && errno == EINTR);
+        if (!channel) {
+            throw std::runtime_error("Server refused a shared-memory channel (a Unix socket address is needed)");
+        }
+        return channel;
+    }
+
+    int doorbell() const {
+        return inDoorbell;
+    }
+
+    // The peer wrote something that is not a valid message.
+    bool broken() const {
+        return corrupt;
+    }
+
+    bool pending() const {
+        return in->tail.load(std::memory_order_acquire) != in->head.load(std::memory_order_relaxed);
+    }
+
+    // Queues one message; false if the peer has let the ring fill up.
+    bool send(std::string_view text) {
+        uint32_t tail = out->tail.load(std::memory_order_relaxed);
+        uint32_t used = tail - out->head.load(std::memory_order_acquire);
+        uint16_t length = uint16_t(text.size());
+        if (text.size() > UINT16_MAX || used > ShmRing::CAPACITY ||
+            sizeof(length) + text.size() > ShmRing::CAPACITY - used) {
+            return false;
+        }
+        copyIn(out, tail, &length, sizeof(length));
+        copyIn(out, tail + sizeof(length), text.data(), text.size());
+        out->tail.store(tail + uint32_t(sizeof(length) + text.size()), std::memory_order_release);
+
+        // Pairs with the fence in sleep(): either the reader sees the
+        // message before blocking or we see that it sleeps
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (out->sleeping.load(std::memory_order_relaxed)) {
+            uint64_t one = 1;
+            ssize_t ignored = write(outDoorbell, &one, sizeof(one));
+            (void)ignored;
+        }
+        return true;
+    }
+
+    // The next message, if one has arrived. The view stays valid until the
+    // next call.
+    bool receive(std::string_view& text) {
+        uint32_t head = in->head.load(std::memory_order_relaxed);
+        uint32_t available = in->tail.load(std::memory_order_acquire) - head;
+        if (available == 0 || corrupt) {
+            return false;
+        }
+        uint16_t length;
+        if (available < sizeof(length) || available > ShmRing::CAPACITY) {
+            corrupt = true;
+            return false;
+        }
+        copyOut(in, head, &length, sizeof(length));
+        if (length > available - sizeof(length)) {
+            corrupt = true;
+            return false;
+        }
+        copyOut(in, head + sizeof(length), message, length);
+        in->head.store(head + uint32_t(sizeof(length) + length), std::memory_order_release);
+        text = std::string_view(message, length);
+        return true;
+    }
+
+    // Announces that this side is about to block on its doorbell. Returns
+    // false, staying awake, if a message is already waiting.
+    bool sleep() {
+        in->sleeping.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (in->tail.load(std::memory_order_relaxed) != in->head.load(std::memory_order_relaxed)) {
+            in->sleeping.store(0, std::memory_order_relaxed);
+            return false;
+        }
+        return true;
+    }
+
+    // Back from blocking, whether the doorbell rang or not.
+    void wake() {
+        in->sleeping.store(0, std::memory_order_relaxed);
+    }
+
+    // Resets the doorbell after it rang.
+    void clearDoorbell() {
+        uint64_t value;
+        ssize_t ignored = read(inDoorbell, &value, sizeof(value));
+        (void)ignored;
+    }
+
+    // Client side, blocking: polls for the next message for a while, then
+    // sleeps until the doorbell rings or `socket` reports that the server
+    // has gone. Returns false once no message can come any more.
+    bool wait(int socket, std::string_view& text) {
+        using Clock = std::chrono::steady_clock;
+        auto deadline = Clock::now() + spinTime();
+        while (true) {
+            if (receive(text)) return true;
+            if (corrupt) return false;
+            if (Clock::now() < deadline) {
+                cpuRelax();
+                continue;
+            }
+            if (sleep()) {
+                struct pollfd watched[2] = {{inDoorbell, POLLIN, 0}, {socket, POLLIN, 0}};
+                int ready = poll(watched, 2, -1);
+                wake();
+                if (ready > 0 && watched[0].revents) clearDoorbell();
+                if (ready < 0 && errno != EINTR) return false;
+                if (ready > 0 && watched[1].revents) return receive(text);
+            }
+            deadline = Clock::now() + spinTime();
+        }
+    }
+};
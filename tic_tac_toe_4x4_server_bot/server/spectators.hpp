@@ -0,0 +1,378 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "logger.hpp"
+
+// Live game events for spectators. Workers publish events without blocking:
+// while nobody watches a publish is one relaxed load, otherwise it is a
+// short append under a lock the hub thread only holds to swap the batch
+// out. The hub thread fans events out to its subscribers, each through its
+// own fixed-size ring, and drops a subscriber whose ring overflows. Every
+// game's start and end also updates a sharded set of live games, one short
+// lock each, so a subscriber to a game that is not in progress is told so
+// and closed instead of waiting for an end that never comes.
+//
+// Events, one line each (cells and moves as in the game protocol):
+//     800 <game> <X name> <O name>      game started
+//     810 <game> <1|2> <move> <board>   move applied; board is size*size of -, X, O
+//     820 <game> <result> <reason>      game ended; GameLogResult, GameLogReason
+//     830 <game>                        no such game in progress; the connection closes
+
+// Fixed-capacity byte ring for one subscriber's unsent output.
+class ByteRing {
+private:
+    std::unique_ptr<char[]> buffer;
+    size_t capacity;
+    size_t head;   // total bytes written to the socket
+    size_t tail;   // total bytes queued
+
+public:
+    explicit ByteRing(size_t size) : buffer(new char[size]), capacity(size), head(0), tail(0) {}
+
+    size_t size() const {
+        return tail - head;
+    }
+
+    bool empty() const {
+        return head == tail;
+    }
+
+    // Queues all of `data`, or nothing if it does not fit.
+    bool push(std::string_view data) {
+        if (data.size() > capacity - size()) {
+            return false;
+        }
+        size_t offset = tail % capacity;
+        size_t first = std::min(data.size(), capacity - offset);
+        std::memcpy(buffer.get() + offset, data.data(), first);
+        std::memcpy(buffer.get(), data.data() + first, data.size() - first);
+        tail += data.size();
+        return true;
+    }
+
+    // Sends as much as the socket takes; returns false on a socket error.
+    bool sendTo(int fd) {
+        while (!empty()) {
+            size_t offset = head % capacity;
+            size_t first = std::min(size(), capacity - offset);
+            struct iovec parts[2] = {
+                {buffer.get() + offset, first},
+                {buffer.get(), size() - first}
+            };
+            struct msghdr message = {};
+            message.msg_iov = parts;
+            message.msg_iovlen = parts[1].iov_len > 0 ? 2 : 1;
+            ssize_t sent = sendmsg(fd, &message, MSG_NOSIGNAL);
+            if (sent < 0) {
+                if (errno == EINTR) continue;
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+            head += size_t(sent);
+        }
+        return true;
+    }
+};
+
+class SpectatorHub {
+public:
+    static const uint64_t ALL_GAMES = 0;
+
+private:
+    static const int TICK_MS = 20;              // longest time an event waits for the hub
+    static const int LIVE_SHARDS = 16;
+
+    struct Event {
+        uint64_t game;
+        bool last;                              // the game's final event
+        std::string text;
+    };
+
+    struct Subscriber {
+        int fd;
+        uint64_t game;                          // ALL_GAMES or one game id
+        ByteRing output;
+        bool wantWrite;
+        bool closing;                           // closes once output is sent
+        bool lagging;                           // overflowed; dropped after the batch
+
+        Subscriber(int socket, uint64_t gameId, size_t bufferBytes)
+            : fd(socket), game(gameId), output(bufferBytes), wantWrite(false), closing(false), lagging(false) {}
+    };
+
+    struct Newcomer {
+        int fd;
+        uint64_t game;
+        std::string output;                     // bytes the worker had not sent yet
+    };
+
+    // Ids of the games in progress, split by id so that workers starting
+    // and ending games rarely take the same lock.
+    struct LiveGames {
+        std::mutex mutex;
+        std::unordered_set<uint64_t> ids;
+    };
+
+    std::mutex mutex;
+    std::vector<Event> pending;
+    std::vector<Newcomer> newcomers;
+    std::atomic<int> subscriberCount;
+    std::atomic<uint64_t> droppedCount;
+    std::atomic<bool> stopping;
+    size_t ringBytes;                           // a subscriber this far behind is dropped
+    LiveGames live[LIVE_SHARDS];
+
+    int epollFd;
+    int wakeFd;
+    std::unordered_map<int, std::unique_ptr<Subscriber>> subscribers;   // by fd
+    std::unordered_map<uint64_t, std::vector<Subscriber*>> byGame;
+    std::vector<Subscriber*> allGames;
+    std::thread thread;
+
+    void run() {
+        std::vector<Event> batch;
+        std::vector<Newcomer> joining;
+        struct epoll_event events[64];
+        while (!stopping.load(std::memory_order_relaxed)) {
+            int timeout = subscribers.empty() ? -1 : TICK_MS;
+            int eventCount = epoll_wait(epollFd, events, 64, timeout);
+            for (int i = 0; i < eventCount; i++) {
+                int fd = events[i].data.fd;
+                if (fd == wakeFd) {
+                    uint64_t value;
+                    ssize_t ignored = read(wakeFd, &value, sizeof(value));
+                    (void)ignored;
+                    continue;
+                }
+                auto it = subscribers.find(fd);
+                if (it == subscribers.end()) continue;
+                Subscriber* subscriber = it->second.get();
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                    // Spectators have nothing to say; anything readable is
+                    // a request to stop or the end of the connection
+                    char discard[256];
+                    ssize_t received = recv(fd, discard, sizeof(discard), 0);
+                    if (received == 0 || (received < 0 && errno != EAGAIN && errno != EINTR)) {
+                        remove(subscriber);
+                        continue;
+                    }
+                }
+                if (events[i].events & EPOLLOUT) {
+                    flush(subscriber);
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                batch.swap(pending);
+                joining.swap(newcomers);
+            }
+            for (Newcomer& newcomer : joining) {
+                add(newcomer);
+            }
+            joining.clear();
+
+            // Fan out, then write each subscriber once per batch
+            std::vector<Subscriber*> touched;
+            for (const Event& event : batch) {
+                auto watchers = byGame.find(event.game);
+                if (watchers != byGame.end()) {
+                    for (Subscriber* subscriber : watchers->second) {
+                        deliver(subscriber, event, touched);
+                    }
+                }
+                for (Subscriber* subscriber : allGames) {
+                    deliver(subscriber, event, touched);
+                }
+            }
+            batch.clear();
+            for (Subscriber* subscriber : touched) {
+                if (subscriber->fd < 0) {
+                    continue;
+                } else if (subscriber->lagging) {
+                    LOG(INFO) << "Spectator dropped: more than " << ringBytes << " bytes behind";
+                    droppedCount.fetch_add(1, std::memory_order_relaxed);
+                    remove(subscriber);
+                } else {
+                    flush(subscriber);
+                }
+            }
+            for (auto it = subscribers.begin(); it != subscribers.end();) {
+                if (it->second->fd < 0) it = subscribers.erase(it);
+                else ++it;
+            }
+        }
+    }
+
+    void add(Newcomer& newcomer) {
+        std::unique_ptr<Subscriber> subscriber(new Subscriber(newcomer.fd, newcomer.game, ringBytes));
+        subscriber->output.push(newcomer.output);
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = newcomer.fd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, newcomer.fd, &event);
+
+        Subscriber* added = subscriber.get();
+        subscribers[newcomer.fd] = std::move(subscriber);
+        if (newcomer.game == ALL_GAMES) {
+            allGames.push_back(added);
+        } else if (isLive(newcomer.game)) {
+            byGame[newcomer.game].push_back(added);
+        } else {
+            // Over or never started, so no final event will come. A game
+            // that ends after this check publishes its end to us: it leaves
+            // the live set before publishing.
+            added->output.push("830 " + std::to_string(newcomer.game) + "\n");
+            added->closing = true;
+        }
+        flush(added);
+    }
+
+    bool isLive(uint64_t game) {
+        LiveGames& shard = live[game % LIVE_SHARDS];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return shard.ids.count(game) > 0;
+    }
+
+    void deliver(Subscriber* subscriber, const Event& event, std::vector<Subscriber*>& touched) {
+        if (subscriber->closing || subscriber->lagging) return;
+        if (!subscriber->output.push(event.text)) {
+            subscriber->lagging = true;
+        } else if (event.last && subscriber->game != ALL_GAMES) {
+            subscriber->closing = true;   // the one game it watched is over
+        }
+        if (touched.empty() || touched.back() != subscriber) touched.push_back(subscriber);
+    }
+
+    void flush(Subscriber* subscriber) {
+        if (!subscriber->output.sendTo(subscriber->fd)) {
+            remove(subscriber);
+            return;
+        }
+        if (subscriber->output.empty() && subscriber->closing) {
+            remove(subscriber);
+            return;
+        }
+        bool wantWrite = !subscriber->output.empty();
+        if (wantWrite != subscriber->wantWrite) {
+            struct epoll_event event = {};
+            event.events = wantWrite ? EPOLLIN | EPOLLOUT : EPOLLIN;
+            event.data.fd = subscriber->fd;
+            epoll_ctl(epollFd, EPOLL_CTL_MOD, subscriber->fd, &event);
+            subscriber->wantWrite = wantWrite;
+        }
+    }
+
+    // Unsubscribes and closes; the entry itself is erased after the batch.
+    void remove(Subscriber* subscriber) {
+        if (subscriber->fd < 0) return;
+        std::vector<Subscriber*>& list = subscriber->game == ALL_GAMES ? allGames : byGame[subscriber->game];
+        for (size_t i = 0; i < list.size(); i++) {
+            if (list[i] == subscriber) {
+                list[i] = list.back();
+                list.pop_back();
+                break;
+            }
+        }
+        if (subscriber->game != ALL_GAMES && list.empty()) {
+            byGame.erase(subscriber->game);
+        }
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, subscriber->fd, nullptr);
+        close(subscriber->fd);
+        subscriber->fd = -1;
+        subscriberCount.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+public:
+    explicit SpectatorHub(size_t bufferBytes = 256 << 10)
+        : subscriberCount(0), droppedCount(0), stopping(false), ringBytes(bufferBytes) {
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epollFd < 0 || wakeFd < 0) {
+            throw std::runtime_error("Failed to create spectator event loop");
+        }
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = wakeFd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+        thread = std::thread(&SpectatorHub::run, this);
+    }
+
+    ~SpectatorHub() {
+        stopping.store(true);
+        uint64_t one = 1;
+        ssize_t ignored = write(wakeFd, &one, sizeof(one));
+        (void)ignored;
+        thread.join();
+        for (auto& entry : subscribers) {
+            if (entry.second->fd >= 0) close(entry.second->fd);
+        }
+        for (Newcomer& newcomer : newcomers) {
+            close(newcomer.fd);
+        }
+        close(wakeFd);
+        close(epollFd);
+    }
+
+    // Whether events are wanted at all; workers skip formatting otherwise.
+    bool watching() const {
+        return subscriberCount.load(std::memory_order_relaxed) > 0;
+    }
+
+    int spectators() const {
+        return subscriberCount.load(std::memory_order_relaxed);
+    }
+
+    uint64_t dropped() const {
+        return droppedCount.load(std::memory_order_relaxed);
+    }
+
+    // Takes over a connected socket that asked to watch one game or all.
+    void subscribe(int fd, uint64_t game, std::string unsent) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            newcomers.push_back(Newcomer{fd, game, std::move(unsent)});
+        }
+        subscriberCount.fetch_add(1, std::memory_order_relaxed);
+        uint64_t one = 1;
+        ssize_t ignored = write(wakeFd, &one, sizeof(one));
+        (void)ignored;
+    }
+
+    // Workers report every game's start and end, watched or not, so that
+    // subscribers to one game can be checked against the games in progress.
+    // A game must end here before its final event is published.
+    void gameStarted(uint64_t game) {
+        LiveGames& shard = live[game % LIVE_SHARDS];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.ids.insert(game);
+    }
+
+    void gameEnded(uint64_t game) {
+        LiveGames& shard = live[game % LIVE_SHARDS];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.ids.erase(game);
+    }
+
+    void publish(uint64_t game, std::string text, bool last = false) {
+        text += '\n';
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.push_back(Event{game, last, std::move(text)});
+    }
+};
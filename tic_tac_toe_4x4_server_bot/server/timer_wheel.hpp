@@ -0,0 +1,115 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// Hashed timer wheel for one event loop. Timers are intrusive nodes kept in
+// per-tick slots, so scheduling and cancelling are O(1) whatever the number
+// of timers; a timer due more than one revolution ahead stays in its slot
+// and is passed over until its round comes. Expiry is rounded up to the
+// next tick.
+template <typename Owner>
+class TimerWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Node {
+        Node* prev = nullptr;
+        Node* next = nullptr;
+        uint64_t expiryTick = 0;
+        Owner* owner = nullptr;
+
+        bool scheduled() const {
+            return prev != nullptr;
+        }
+    };
+
+private:
+    std::chrono::milliseconds tickLength;
+    Clock::time_point origin;
+    std::vector<Node> slots;            // list heads; a node is linked in one of them
+    uint64_t currentTick;               // every tick up to this one has expired
+    size_t count;
+    std::vector<Owner*> expired;        // reused by advance()
+
+    uint64_t tickAt(Clock::time_point time) const {
+        if (time <= origin) return 0;
+        return uint64_t((time - origin + tickLength - Clock::duration(1)) / tickLength);
+    }
+
+    void link(Node* node, Node* head) {
+        node->prev = head;
+        node->next = head->next;
+        head->next->prev = node;
+        head->next = node;
+    }
+
+    void unlink(Node* node) {
+        node->prev->next = node->next;
+        node->next->prev = node->prev;
+        node->prev = node->next = nullptr;
+    }
+
+public:
+    TimerWheel(std::chrono::milliseconds tick, size_t slotCount)
+        : tickLength(tick), origin(Clock::now()), slots(slotCount), currentTick(0), count(0) {
+        for (Node& head : slots) {
+            head.prev = head.next = &head;
+        }
+    }
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    std::chrono::milliseconds tick() const {
+        return tickLength;
+    }
+
+    // (Re)schedules `node` to expire at `deadline`.
+    void schedule(Node* node, Clock::time_point deadline) {
+        if (node->scheduled()) cancel(node);
+        node->expiryTick = std::max(tickAt(deadline), currentTick + 1);
+        link(node, &slots[node->expiryTick % slots.size()]);
+        count++;
+    }
+
+    void cancel(Node* node) {
+        if (!node->scheduled()) return;
+        unlink(node);
+        count--;
+    }
+
+    // Expires every timer due by `now`, then calls `expire(owner)` for each;
+    // the callback may schedule or cancel timers, but must not destroy the
+    // owner of another timer that expired in the same call.
+    template <typename Callback>
+    void advance(Clock::time_point now, Callback expire) {
+        uint64_t target = uint64_t((now - origin) / tickLength);
+        if (target <= currentTick) return;
+
+        // After a long stall every slot is visited once, not every tick
+        uint64_t first = target - currentTick > slots.size() ? target - slots.size() + 1 : currentTick + 1;
+        currentTick = target;
+        for (uint64_t tick = first; tick <= target; tick++) {
+            Node* head = &slots[tick % slots.size()];
+            for (Node* node = head->next; node != head;) {
+                Node* next = node->next;
+                if (node->expiryTick <= target) {
+                    unlink(node);
+                    count--;
+                    expired.push_back(node->owner);
+                }
+                node = next;
+            }
+        }
+        for (Owner* owner : expired) {
+            expire(owner);
+        }
+        expired.clear();
+    }
+};
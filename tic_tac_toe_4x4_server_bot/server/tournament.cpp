@@ -0,0 +1,433 @@
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "engine.hpp"
+#include "eval_weights.hpp"
+#include "mcts.hpp"
+
+// Plays engine configurations against each other in-process, with the
+// engine's bitboard rules (four in a row wins, three in a row loses, a full
+// board is a draw), on a pool of threads. Every opening is played twice with
+// colours swapped. Reports W/D/L, Elo with a 95% interval and games/sec, and
+// can stop a two-engine match early with an SPRT.
+
+struct EngineConfig {
+    std::string name;
+    std::string type = "alphabeta";  // alphabeta, mcts or random
+    int depth = 5;
+    int moveTimeMs = 0;
+    uint64_t playouts = 0;
+    int threads = 1;
+    bool rave = false;
+    bool threats = true;
+    bool quiescence = true;
+    int ttBits = 18;
+    EvalWeights weights;
+};
+
+static bool parseEngineConfig(const std::string& spec, EngineConfig& config) {
+    std::istringstream fields(spec);
+    std::string field;
+    while (std::getline(fields, field, ',')) {
+        size_t equals = field.find('=');
+        std::string key = field.substr(0, equals);
+        std::string value = equals == std::string::npos ? "" : field.substr(equals + 1);
+        try {
+            if (key == "name") config.name = value;
+            else if (key == "type") config.type = value;
+            else if (key == "depth") config.depth = std::stoi(value);
+            else if (key == "movetime") config.moveTimeMs = std::stoi(value);
+            else if (key == "playouts") config.playouts = std::stoull(value);
+            else if (key == "threads") config.threads = std::stoi(value);
+            else if (key == "rave") config.rave = true;
+            else if (key == "threats") config.threats = std::stoi(value) != 0;
+            else if (key == "quiescence") config.quiescence = std::stoi(value) != 0;
+            else if (key == "tt") config.ttBits = std::stoi(value);
+            else if (key == "weights") {
+                if (!loadWeights(value, config.weights)) return false;
+            }
+            else return false;
+        } catch (const std::exception& e) {
+            return false;
+        }
+    }
+    if (config.name.empty()) config.name = spec;
+    if (config.type != "alphabeta" && config.type != "mcts" && config.type != "random") return false;
+    if (config.depth < 1 || config.depth > MAX_DEPTH) return false;
+    return config.moveTimeMs >= 0 && config.threads >= 1;
+}
+
+// One configured player, owned by one pool thread, for the variant whose
+// Rules it is compiled for. MCTS only knows the 5x5 board.
+template <class R>
+class Player {
+private:
+    typedef BasicPosition<R> Position;
+
+    EngineConfig config;
+    std::unique_ptr<BasicEngine<R>> engine;
+    std::unique_ptr<MctsEngine> mcts;
+    std::mt19937 rng;
+
+public:
+    Player(const EngineConfig& engineConfig, unsigned seed) : config(engineConfig), rng(seed) {
+        if (config.type == "alphabeta") {
+            engine.reset(new BasicEngine<R>(seed, config.ttBits));
+            engine->setWeights(config.weights);
+        } else if (config.type == "mcts" && std::is_same<R, DefaultRules>::value) {
+            MctsOptions options;
+            options.threads = config.threads;
+            options.rave = config.rave;
+            mcts.reset(new MctsEngine(options, seed));
+        }
+    }
+
+    void newGame() {
+        if (engine) engine->clear();
+    }
+
+    int chooseMove(const Position& position) {
+        SearchLimits limits;
+        limits.depth = config.depth;
+        limits.moveTimeMs = config.moveTimeMs;
+        limits.nodes = config.playouts;
+        limits.threats = config.threats;
+        limits.quiescence = config.quiescence;
+        if (engine) return engine->search(position, limits).move;
+        if constexpr (std::is_same<R, DefaultRules>::value) {
+            if (mcts) return mcts->search(position, limits).move;
+        }
+
+        std::vector<int> cells;
+        for (typename R::Bitboard empty = ~position.occupied() & R::FULL_BOARD; empty; empty &= empty - 1) {
+            cells.push_back(lowestCell(empty));
+        }
+        return cells[std::uniform_int_distribution<size_t>(0, cells.size() - 1)(rng)];
+    }
+};
+
+// Results of one pairing, from the point of view of engine `first`.
+struct PairResult {
+    int first;
+    int second;
+    int wins = 0;
+    int draws = 0;
+    int losses = 0;
+};
+
+// Score fraction, Elo difference and its 95% interval from W/D/L counts.
+struct EloEstimate {
+    double score;
+    double elo;
+    double margin;
+};
+
+static double eloFromScore(double score) {
+    score = std::min(std::max(score, 1e-6), 1.0 - 1e-6);
+    return -400.0 * std::log10(1.0 / score - 1.0);
+}
+
+static EloEstimate estimateElo(int wins, int draws, int losses) {
+    int n = wins + draws + losses;
+    EloEstimate estimate = {0.5, 0.0, 0.0};
+    if (n == 0) return estimate;
+    double score = (wins + 0.5 * draws) / n;
+    double variance = (wins * std::pow(1.0 - score, 2) + draws * std::pow(0.5 - score, 2) +
+                       losses * std::pow(score, 2)) / n;
+    double deviation = std::sqrt(variance / n);
+    estimate.score = score;
+    estimate.elo = eloFromScore(score);
+    estimate.margin = (eloFromScore(score + 1.96 * deviation) - eloFromScore(score - 1.96 * deviation)) / 2.0;
+    return estimate;
+}
+
+// Sequential probability ratio test of H0: elo = elo0 against H1: elo = elo1,
+// using the normal approximation of the log-likelihood ratio for W/D/L.
+// While every game has had the same result the sample variance is zero; the
+// variance is then taken with half a game of each result added, so a match
+// one side never loses still stops.
+struct Sprt {
+    double elo0 = 0.0;
+    double elo1 = 5.0;
+    double alpha = 0.05;
+    double beta = 0.05;
+
+    double lowerBound() const { return std::log(beta / (1.0 - alpha)); }
+    double upperBound() const { return std::log((1.0 - beta) / alpha); }
+
+    double llr(int wins, int draws, int losses) const {
+        int n = wins + draws + losses;
+        if (n == 0) return 0.0;
+        double score = (wins + 0.5 * draws) / n;
+        double variance = (wins * std::pow(1.0 - score, 2) + draws * std::pow(0.5 - score, 2) +
+                           losses * std::pow(score, 2)) / n;
+        if (variance == 0.0) {
+            double padded = (wins + 0.75 + 0.5 * draws) / (n + 1.5);
+            variance = ((wins + 0.5) * std::pow(1.0 - padded, 2) + (draws + 0.5) * std::pow(0.5 - padded, 2) +
+                        (losses + 0.5) * std::pow(padded, 2)) / (n + 1.5);
+        }
+        double s0 = 1.0 / (1.0 + std::pow(10.0, -elo0 / 400.0));
+        double s1 = 1.0 / (1.0 + std::pow(10.0, -elo1 / 400.0));
+        return n * (s1 - s0) * (2.0 * score - s0 - s1) / (2.0 * variance);
+    }
+};
+
+// Random legal opening of `plies` moves that does not end the game.
+template <class R>
+static BasicPosition<R> randomOpening(int plies, unsigned seed) {
+    std::mt19937 rng(seed);
+    while (true) {
+        BasicPosition<R> position;
+        bool ended = false;
+        for (int ply = 0; ply < plies && !ended; ply++) {
+            int cell;
+            do {
+                cell = rng() % R::NUM_CELLS;
+            } while (!position.isEmpty(cell));
+            position.play(cell);
+            ended = position.outcome(cell) != 0;
+        }
+        if (!ended) return position;
+    }
+}
+
+// Plays one game; returns 1 if X wins, -1 if O wins, 0 for a draw.
+template <class R>
+static int playGame(BasicPosition<R> position, Player<R>* players[2]) {
+    players[0]->newGame();
+    players[1]->newGame();
+    while (!position.isFull()) {
+        int side = position.sideToMove();
+        int cell = players[side]->chooseMove(position);
+        if (cell < 0 || !position.isEmpty(cell)) {
+            return side == 0 ? -1 : 1;  // an illegal move loses, as on the server
+        }
+        position.play(cell);
+        int outcome = position.outcome(cell);
+        if (outcome != 0) {
+            int winner = outcome == 1 ? side : 1 - side;
+            return winner == 0 ? 1 : -1;
+        }
+    }
+    return 0;
+}
+
+static void usage(const char* program) {
+    std::cerr << "Usage: " << program << " --engine SPEC --engine SPEC [...] [options]\n"
+              << "  SPEC: comma-separated key=value: name, type=alphabeta|mcts|random, depth,\n"
+              << "        movetime (ms per move), playouts, threads, rave, tt (table bits),\n"
+              << "        threats=0|1 (threat solver, default 1), quiescence=0|1 (forced play at the\n"
+              << "        horizon, default 1), weights=FILE (evaluation weights)\n"
+              << "  --games N          games per pairing (default 100, rounded up to even)\n"
+              << "  --gauntlet         first engine against each other one (default round-robin)\n"
+              << "  --threads N        games played in parallel (default: all cores)\n"
+              << "  --opening-plies N  random plies before the engines take over (default 2)\n"
+              << "  --variant NAME     board to play: " << VARIANT_NAMES << " (default "
+              << VARIANTS[DEFAULT_VARIANT].name << ")\n"
+              << "  --seed N           seed for openings and engines (default 1)\n"
+              << "  --sprt ELO0 ELO1   stop a two-engine match once the SPRT decides\n"
+              << "  --alpha A --beta B SPRT error rates (default 0.05)" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<EngineConfig> configs;
+    int gamesPerPair = 100;
+    bool gauntlet = false;
+    int threadCount = std::max(1u, std::thread::hardware_concurrency());
+    int openingPlies = 2;
+    unsigned seed = 1;
+    int variant = DEFAULT_VARIANT;
+    bool useSprt = false;
+    Sprt sprt;
+
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "--engine" && hasValue) {
+                EngineConfig config;
+                if (!parseEngineConfig(argv[++i], config)) {
+                    std::cerr << "Invalid engine spec: " << argv[i] << std::endl;
+                    return 1;
+                }
+                configs.push_back(config);
+            } else if (arg == "--games" && hasValue) {
+                gamesPerPair = std::stoi(argv[++i]);
+            } else if (arg == "--gauntlet") {
+                gauntlet = true;
+            } else if (arg == "--threads" && hasValue) {
+                threadCount = std::stoi(argv[++i]);
+            } else if (arg == "--opening-plies" && hasValue) {
+                openingPlies = std::stoi(argv[++i]);
+            } else if (arg == "--variant" && hasValue) {
+                variant = findVariant(argv[++i]);
+            } else if (arg == "--seed" && hasValue) {
+                seed = std::stoul(argv[++i]);
+            } else if (arg == "--sprt" && i + 2 < argc) {
+                useSprt = true;
+                sprt.elo0 = std::stod(argv[++i]);
+                sprt.elo1 = std::stod(argv[++i]);
+            } else if (arg == "--alpha" && hasValue) {
+                sprt.alpha = std::stod(argv[++i]);
+            } else if (arg == "--beta" && hasValue) {
+                sprt.beta = std::stod(argv[++i]);
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+    } catch (const std::exception& e) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (configs.size() < 2 || gamesPerPair < 1 || threadCount < 1 || openingPlies < 0 || openingPlies > 8) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (variant < 0) {
+        std::cerr << "Variant must be one of " << VARIANT_NAMES << std::endl;
+        return 1;
+    }
+    for (const auto& config : configs) {
+        if (config.type == "mcts" && variant != DEFAULT_VARIANT) {
+            std::cerr << "MCTS plays " << VARIANTS[DEFAULT_VARIANT].name << " only" << std::endl;
+            return 1;
+        }
+    }
+    if (useSprt && configs.size() != 2) {
+        std::cerr << "--sprt needs exactly two engines" << std::endl;
+        return 1;
+    }
+    gamesPerPair += gamesPerPair % 2;
+
+    std::vector<PairResult> pairs;
+    for (int a = 0; a < int(configs.size()); a++) {
+        for (int b = a + 1; b < int(configs.size()); b++) {
+            if (gauntlet && a != 0) continue;
+            PairResult pair;
+            pair.first = a;
+            pair.second = b;
+            pairs.push_back(pair);
+        }
+    }
+
+    // Game g plays opening g / 2 / pairs with colours chosen by g % 2, so the
+    // pairings advance together and every opening is played both ways.
+    const uint64_t totalGames = uint64_t(gamesPerPair) * pairs.size();
+    std::atomic<uint64_t> nextGame(0);
+    std::atomic<bool> stopped(false);
+    std::mutex resultsMutex;
+    uint64_t finished = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    auto worker = [&](int thread) {
+        withVariant(variant, [&](auto rules) {
+            typedef decltype(rules) R;
+            std::vector<std::unique_ptr<Player<R>>> players;
+            for (size_t e = 0; e < configs.size(); e++) {
+                players.emplace_back(new Player<R>(configs[e], seed * 7919 + thread * 131 + e));
+            }
+
+            while (!stopped.load()) {
+                uint64_t game = nextGame.fetch_add(1);
+                if (game >= totalGames) break;
+                uint64_t slot = game / 2;
+                PairResult& pair = pairs[slot % pairs.size()];
+                uint64_t opening = slot / pairs.size();
+                bool swapped = game % 2 == 1;
+
+                Player<R>* seats[2] = {players[pair.first].get(), players[pair.second].get()};
+                if (swapped) std::swap(seats[0], seats[1]);
+                int result = playGame(randomOpening<R>(openingPlies, seed + unsigned(opening) * 2654435761u), seats);
+                if (swapped) result = -result;
+
+                std::lock_guard<std::mutex> lock(resultsMutex);
+                if (result > 0) pair.wins++;
+                else if (result < 0) pair.losses++;
+                else pair.draws++;
+                finished++;
+
+                if (useSprt) {
+                    double llr = sprt.llr(pair.wins, pair.draws, pair.losses);
+                    if (llr <= sprt.lowerBound() || llr >= sprt.upperBound()) {
+                        stopped = true;
+                    }
+                }
+                if (finished % 100 == 0) {
+                    std::cerr << "\r" << finished << "/" << totalGames << " games" << std::flush;
+                }
+            }
+        });
+    };
+
+    std::vector<std::thread> threads;
+    for (int t = 1; t < threadCount; t++) {
+        threads.emplace_back(worker, t);
+    }
+    worker(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (finished >= 100) std::cerr << "\r" << std::string(40, ' ') << "\r";
+
+    std::cout << "Games: " << finished << " in " << std::fixed << std::setprecision(1) << seconds
+              << " s (" << std::setprecision(1) << finished / std::max(seconds, 1e-9) << " games/sec, "
+              << threadCount << " thread(s))\n\n";
+
+    for (const auto& pair : pairs) {
+        EloEstimate estimate = estimateElo(pair.wins, pair.draws, pair.losses);
+        std::cout << std::left << std::setw(12) << configs[pair.first].name << " vs " << std::setw(12)
+                  << configs[pair.second].name << std::right << " +" << pair.wins << " =" << pair.draws
+                  << " -" << pair.losses << "  score " << std::setprecision(1) << 100.0 * estimate.score
+                  << "%  Elo " << std::showpos << estimate.elo << std::noshowpos << " +/- " << estimate.margin
+                  << "\n";
+    }
+
+    if (configs.size() > 2) {
+        // Each engine's results against the rest of the field
+        std::cout << "\n" << std::left << std::setw(12) << "engine" << std::right << std::setw(8) << "games"
+                  << std::setw(9) << "score" << std::setw(18) << "Elo vs field" << "\n";
+        for (int e = 0; e < int(configs.size()); e++) {
+            int wins = 0, draws = 0, losses = 0;
+            for (const auto& pair : pairs) {
+                if (pair.first == e) {
+                    wins += pair.wins; draws += pair.draws; losses += pair.losses;
+                } else if (pair.second == e) {
+                    wins += pair.losses; draws += pair.draws; losses += pair.wins;
+                }
+            }
+            EloEstimate estimate = estimateElo(wins, draws, losses);
+            std::ostringstream elo;
+            elo << std::fixed << std::setprecision(1) << std::showpos << estimate.elo << std::noshowpos
+                << " +/- " << estimate.margin;
+            std::cout << std::left << std::setw(12) << configs[e].name << std::right << std::setw(8)
+                      << wins + draws + losses << std::setw(8) << 100.0 * estimate.score << "%"
+                      << std::setw(18) << elo.str() << "\n";
+        }
+    }
+
+    if (useSprt) {
+        const PairResult& pair = pairs[0];
+        double llr = sprt.llr(pair.wins, pair.draws, pair.losses);
+        std::cout << "\nSPRT [" << sprt.elo0 << ", " << sprt.elo1 << "]: LLR " << std::setprecision(2) << llr
+                  << " (" << sprt.lowerBound() << ", " << sprt.upperBound() << ") ";
+        if (llr >= sprt.upperBound()) std::cout << "H1 accepted";
+        else if (llr <= sprt.lowerBound()) std::cout << "H0 accepted";
+        else std::cout << "inconclusive";
+        std::cout << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,158 @@
+#pragma once
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "protocol.hpp"
+#include "shm_channel.hpp"
+
+// Server addresses. "unix:/path" is a Unix-domain stream socket at that
+// path and the port is ignored; anything else is an IPv4 address and a TCP
+// port. Both carry the same protocol.
+
+inline bool isUnixAddress(const std::string& address) {
+    return address.compare(0, 5, "unix:") == 0;
+}
+
+inline std::string describeAddress(const std::string& address, int port) {
+    return isUnixAddress(address) ? address : address + ":" + std::to_string(port);
+}
+
+inline struct sockaddr_un unixAddress(const std::string& address) {
+    std::string path = address.substr(5);
+    struct sockaddr_un result = {};
+    result.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(result.sun_path)) {
+        throw std::runtime_error("Invalid Unix socket path: " + path);
+    }
+    std::memcpy(result.sun_path, path.c_str(), path.size() + 1);
+    return result;
+}
+
+inline struct sockaddr_in inetAddress(const std::string& address, int port) {
+    struct sockaddr_in result = {};
+    result.sin_family = AF_INET;
+    result.sin_port = htons(port);
+    if (inet_pton(AF_INET, address.c_str(), &result.sin_addr) != 1) {
+        throw std::runtime_error("Invalid IP address: " + address);
+    }
+    return result;
+}
+
+// Opens a non-blocking listening socket. With `reusePort` several listeners
+// may bind the same TCP port; a Unix socket path has a single listener, and
+// a stale socket file left at it is replaced.
+inline int listenOn(const std::string& address, int port, bool reusePort) {
+    bool local = isUnixAddress(address);
+
+    // Create socket
+    int listener = socket(local ? AF_UNIX : AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (listener < 0) {
+        throw std::runtime_error("Failed to create socket");
+    }
+
+    // Bind socket
+    int bound;
+    if (local) {
+        struct sockaddr_un path = unixAddress(address);
+        unlink(path.sun_path);
+        bound = bind(listener, (struct sockaddr*)&path, sizeof(path));
+    } else {
+        // Set socket options
+        int opt = 1;
+        if (setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
+            throw std::runtime_error("Failed to set socket options");
+        }
+        if (reusePort && setsockopt(listener, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+            throw std::runtime_error("Failed to set SO_REUSEPORT");
+        }
+        struct sockaddr_in inet = inetAddress(address, port);
+        bound = bind(listener, (struct sockaddr*)&inet, sizeof(inet));
+    }
+    if (bound < 0) {
+        close(listener);
+        throw std::runtime_error("Socket binding failed: " + std::string(std::strerror(errno)));
+    }
+
+    // Listen for connections
+    if (listen(listener, SOMAXCONN) < 0) {
+        close(listener);
+        throw std::runtime_error("Socket listen failed");
+    }
+    return listener;
+}
+
+// Starts connecting to the server. A blocking socket returns connected; a
+// non-blocking one may still be connecting (EINPROGRESS, or EAGAIN for a
+// Unix socket whose backlog is full). Returns -1 with errno set on failure.
+inline int connectTo(const std::string& address, int port, bool nonBlocking = false) {
+    bool local = isUnixAddress(address);
+    int fd = socket(local ? AF_UNIX : AF_INET, SOCK_STREAM | (nonBlocking ? SOCK_NONBLOCK : 0), 0);
+    if (fd < 0) {
+        return -1;
+    }
+    int result;
+    if (local) {
+        struct sockaddr_un path = unixAddress(address);
+        result = connect(fd, (struct sockaddr*)&path, sizeof(path));
+    } else {
+        struct sockaddr_in inet = inetAddress(address, port);
+        result = connect(fd, (struct sockaddr*)&inet, sizeof(inet));
+    }
+    if (result < 0 && !(nonBlocking && errno == EINPROGRESS)) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+    return fd;
+}
+
+// A bot's blocking connection to the server. Messages go over the socket,
+// or, once useSharedMemory() has succeeded, through a shared-memory channel
+// while the socket stays open to tell when either side goes away.
+class ServerConnection {
+private:
+    int socket;
+    FrameReader input;
+    std::unique_ptr<ShmChannel> channel;
+
+public:
+    // `legacyLength` as for FrameReader: server codes are three digits.
+    ServerConnection(const std::string& address, int port, size_t legacyLength = 3)
+        : input(legacyLength) {
+        socket = connectTo(address, port);
+        if (socket < 0) {
+            throw std::runtime_error("Connection to " + describeAddress(address, port) + " failed: " +
+                                     std::strerror(errno));
+        }
+    }
+
+    ~ServerConnection() {
+        close(socket);
+    }
+
+    ServerConnection(const ServerConnection&) = delete;
+    ServerConnection& operator=(const ServerConnection&) = delete;
+
+    // Moves the rest of the conversation to shared memory. Only a server on
+    // a Unix socket can grant it; call it after the welcome.
+    void useSharedMemory() {
+        channel = ShmChannel::request(socket);
+    }
+
+    bool send(std::string_view message) {
+        return channel ? channel->send(message) : sendFrame(socket, message);
+    }
+
+    // Blocks for the next message; false once the connection is gone.
+    bool receive(std::string_view& message) {
+        return channel ? channel->wait(socket, message) : input.receive(socket, message);
+    }
+};
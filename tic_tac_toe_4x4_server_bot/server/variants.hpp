@@ -0,0 +1,32 @@
+#pragma once
+#include <string>
+
+// Board variants the server and the engine can play, chosen with --variant.
+// Every variant keeps the rules of the original game: four in a row wins,
+// three in a row loses, a full board is a draw. Moves stay two digits, row
+// then column, so boards go up to 9x9.
+struct Variant {
+    const char* name;
+    int size;
+    int winLength;
+    int loseLength;
+};
+
+constexpr Variant VARIANTS[] = {
+    {"4x4", 4, 4, 3},
+    {"5x5", 5, 4, 3},
+    {"6x6", 6, 4, 3},
+    {"7x7", 7, 4, 3},
+};
+
+constexpr int VARIANT_COUNT = sizeof(VARIANTS) / sizeof(VARIANTS[0]);
+constexpr int DEFAULT_VARIANT = 1;
+constexpr const char* VARIANT_NAMES = "4x4, 5x5, 6x6, 7x7";
+
+// Index into VARIANTS, or -1 for an unknown name.
+inline int findVariant(const std::string& name) {
+    for (int i = 0; i < VARIANT_COUNT; i++) {
+        if (name == VARIANTS[i].name) return i;
+    }
+    return -1;
+}